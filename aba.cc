@@ -0,0 +1,174 @@
+#include "aba.hh"
+
+static Eigen::Matrix3d skew(const Eigen::Vector3d &v)
+{
+  Eigen::Matrix3d result;
+  result << 0.0, -v(2), v(1),
+            v(2), 0.0, -v(0),
+            -v(1), v(0), 0.0;
+  return result;
+}
+
+static Eigen::Vector3d toEigen(const chrono::ChVector3d &v)
+{
+  return Eigen::Vector3d(v.x(), v.y(), v.z());
+}
+
+static Eigen::Matrix3d toEigen(const chrono::ChQuaterniond &q)
+{
+  return Eigen::Quaterniond(q.e0(), q.e1(), q.e2(), q.e3()).toRotationMatrix();
+}
+
+// Plücker transform for motion vectors from a frame A to a frame B rotated by E (B coordinates = E * A coordinates)
+// and with its origin at r (in A coordinates)
+static SpatialMatrix motionTransform(const Eigen::Matrix3d &E, const Eigen::Vector3d &r)
+{
+  SpatialMatrix result = SpatialMatrix::Zero();
+  result.block<3, 3>(0, 0) = E;
+  result.block<3, 3>(3, 0) = -E * skew(r);
+  result.block<3, 3>(3, 3) = E;
+  return result;
+}
+
+// Spatial cross product for motion vectors
+static SpatialMatrix crossMotion(const SpatialVector &v)
+{
+  SpatialMatrix result = SpatialMatrix::Zero();
+  result.block<3, 3>(0, 0) = skew(v.head<3>());
+  result.block<3, 3>(3, 0) = skew(v.tail<3>());
+  result.block<3, 3>(3, 3) = skew(v.head<3>());
+  return result;
+}
+
+// Spatial cross product for force vectors
+static SpatialMatrix crossForce(const SpatialVector &v)
+{
+  return -crossMotion(v).transpose();
+}
+
+ArticulatedBody::ArticulatedBody(std::shared_ptr<chrono::ChBody> root, const std::vector<std::shared_ptr<chrono::ChBody>> &bodies,
+                                 const std::vector<std::shared_ptr<chrono::ChLinkRevolute>> &joints,
+                                 const std::vector<int> &parents, const chrono::ChVector3d &gravity):
+  size(bodies.size()), q(Eigen::VectorXd::Zero(bodies.size())), qd(Eigen::VectorXd::Zero(bodies.size())),
+  qdd(Eigen::VectorXd::Zero(bodies.size())), tau(Eigen::VectorXd::Zero(bodies.size())), bodies(bodies), parents(parents),
+  transform(bodies.size()), velocity(bodies.size()), bias(bodies.size()), articulated_inertia(bodies.size()),
+  articulated_force(bodies.size()), U(bodies.size()), D(bodies.size()), u(bodies.size()),
+  world_rotation(bodies.size()), world_position(bodies.size())
+{
+  root_rotation = toEigen(root->GetRot());
+  root_position = toEigen(root->GetPos());
+  // Acceleration of the root opposing gravity accounts for the weight of all links.
+  // Gravity is given in world coordinates and the root acceleration is expressed in root coordinates.
+  Eigen::Vector3d root_gravity = root_rotation.transpose() * toEigen(gravity);
+  this->gravity << 0.0, 0.0, 0.0, -root_gravity.x(), -root_gravity.y(), -root_gravity.z();
+  for (int i=0; i<size; i++) {
+    Eigen::Matrix3d rotation = toEigen(bodies[i]->GetRot());
+    Eigen::Vector3d joint = toEigen(joints[i]->GetFrame1Abs().GetPos());
+    Eigen::Matrix3d parent_rotation = parents[i] < 0 ? root_rotation : toEigen(bodies[parents[i]]->GetRot());
+    Eigen::Vector3d parent_joint = parents[i] < 0 ? root_position : toEigen(joints[parents[i]]->GetFrame1Abs().GetPos());
+    tree_rotation.push_back(rotation.transpose() * parent_rotation);
+    tree_translation.push_back(parent_rotation.transpose() * (joint - parent_joint));
+    axis.push_back(rotation.transpose() * toEigen(joints[i]->GetFrame1Abs().GetRot().GetAxisZ()));
+    Eigen::Vector3d c = rotation.transpose() * (toEigen(bodies[i]->GetPos()) - joint);
+    com.push_back(c);
+    double mass = bodies[i]->GetMass();
+    chrono::ChVector3d xx = bodies[i]->GetInertiaXX();
+    chrono::ChVector3d xy = bodies[i]->GetInertiaXY();
+    Eigen::Matrix3d inertia_com;
+    inertia_com << xx.x(), xy.x(), xy.y(),
+                   xy.x(), xx.y(), xy.z(),
+                   xy.y(), xy.z(), xx.z();
+    SpatialMatrix I;
+    I.block<3, 3>(0, 0) = inertia_com + mass * skew(c) * skew(c).transpose();
+    I.block<3, 3>(0, 3) = mass * skew(c);
+    I.block<3, 3>(3, 0) = mass * skew(c).transpose();
+    I.block<3, 3>(3, 3) = mass * Eigen::Matrix3d::Identity();
+    inertia.push_back(I);
+  };
+  kinematics();
+}
+
+void ArticulatedBody::kinematics(void)
+{
+  for (int i=0; i<size; i++) {
+    // Joint rotation maps link coordinates at q = 0 to the rotated link frame
+    Eigen::Matrix3d joint_rotation = Eigen::AngleAxisd(q(i), axis[i]).toRotationMatrix().transpose();
+    transform[i] = motionTransform(joint_rotation * tree_rotation[i], tree_translation[i]);
+    Eigen::Matrix3d parent_rotation = parents[i] < 0 ? root_rotation : world_rotation[parents[i]];
+    Eigen::Vector3d parent_position = parents[i] < 0 ? root_position : world_position[parents[i]];
+    world_rotation[i] = parent_rotation * (joint_rotation * tree_rotation[i]).transpose();
+    world_position[i] = parent_position + parent_rotation * tree_translation[i];
+    SpatialVector S;
+    S << axis[i], Eigen::Vector3d::Zero();
+    SpatialVector vJ = S * qd(i);
+    velocity[i] = parents[i] < 0 ? vJ : SpatialVector(transform[i] * velocity[parents[i]] + vJ);
+  };
+}
+
+void ArticulatedBody::update(void)
+{
+  kinematics();
+  for (int i=0; i<size; i++) {
+    SpatialVector S;
+    S << axis[i], Eigen::Vector3d::Zero();
+    bias[i] = crossMotion(velocity[i]) * S * qd(i);
+    articulated_inertia[i] = inertia[i];
+    articulated_force[i] = crossForce(velocity[i]) * inertia[i] * velocity[i];
+  };
+  for (int i=size-1; i>=0; i--) {
+    SpatialVector S;
+    S << axis[i], Eigen::Vector3d::Zero();
+    U[i] = articulated_inertia[i] * S;
+    D[i] = S.dot(U[i]);
+    u[i] = tau(i) - S.dot(articulated_force[i]);
+    if (parents[i] >= 0) {
+      SpatialMatrix Ia = articulated_inertia[i] - U[i] * U[i].transpose() / D[i];
+      SpatialVector pa = articulated_force[i] + Ia * bias[i] + U[i] * u[i] / D[i];
+      articulated_inertia[parents[i]] += transform[i].transpose() * Ia * transform[i];
+      articulated_force[parents[i]] += transform[i].transpose() * pa;
+    };
+  };
+  std::vector<SpatialVector> acceleration(size);
+  for (int i=0; i<size; i++) {
+    SpatialVector S;
+    S << axis[i], Eigen::Vector3d::Zero();
+    SpatialVector parent_acceleration = parents[i] < 0 ? gravity : acceleration[parents[i]];
+    acceleration[i] = transform[i] * parent_acceleration + bias[i];
+    qdd(i) = (u[i] - U[i].dot(acceleration[i])) / D[i];
+    acceleration[i] += S * qdd(i);
+  };
+}
+
+void ArticulatedBody::step(double dt)
+{
+  update();
+  qd += qdd * dt;
+  q += qd * dt;
+  kinematics();
+}
+
+chrono::ChVector3d ArticulatedBody::position(int i) const
+{
+  Eigen::Vector3d p = world_position[i] + world_rotation[i] * com[i];
+  return chrono::ChVector3d(p(0), p(1), p(2));
+}
+
+chrono::ChQuaterniond ArticulatedBody::rotation(int i) const
+{
+  Eigen::Quaterniond r(world_rotation[i]);
+  return chrono::ChQuaterniond(r.w(), r.x(), r.y(), r.z());
+}
+
+void ArticulatedBody::apply(void)
+{
+  for (int i=0; i<size; i++) {
+    bodies[i]->SetPos(position(i));
+    bodies[i]->SetRot(rotation(i));
+    // Spatial velocity holds the angular velocity and the velocity of the link frame origin in link coordinates
+    Eigen::Vector3d omega = velocity[i].head<3>();
+    Eigen::Vector3d v = world_rotation[i] * (velocity[i].tail<3>() + omega.cross(com[i]));
+    Eigen::Vector3d w = world_rotation[i] * omega;
+    bodies[i]->SetPosDt(chrono::ChVector3d(v(0), v(1), v(2)));
+    bodies[i]->SetAngVelParent(chrono::ChVector3d(w(0), w(1), w(2)));
+  };
+}
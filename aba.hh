@@ -0,0 +1,63 @@
+#pragma once
+#include <memory>
+#include <vector>
+#include <Eigen/Dense>
+#include <chrono/physics/ChBody.h>
+#include <chrono/physics/ChLinkRevolute.h>
+
+typedef Eigen::Matrix<double, 6, 1> SpatialVector;
+typedef Eigen::Matrix<double, 6, 6> SpatialMatrix;
+
+// Reduced-coordinate model of a tree of rigid bodies connected with revolute joints.
+// Joint accelerations are computed with Featherstone's articulated-body algorithm in O(N) and integrated with semi-implicit Euler.
+// The model is built from the Chrono bodies and joints in their initial configuration and starts at rest.
+// Spatial vectors have the angular part first. Each link frame has its origin at the link's joint and
+// the orientation of the Chrono body.
+class ArticulatedBody {
+public:
+  // "parents[i]" is the index of the parent of body i or -1 if the joint connects body i to the fixed root.
+  ArticulatedBody(std::shared_ptr<chrono::ChBody> root, const std::vector<std::shared_ptr<chrono::ChBody>> &bodies,
+                  const std::vector<std::shared_ptr<chrono::ChLinkRevolute>> &joints, const std::vector<int> &parents,
+                  const chrono::ChVector3d &gravity);
+
+  void step(double dt);
+  // Compute joint accelerations for the current joint angles and rates
+  void update(void);
+  // Write poses and velocities of the links to the Chrono bodies
+  void apply(void);
+
+  chrono::ChVector3d position(int i) const;
+  chrono::ChQuaterniond rotation(int i) const;
+
+  int size;
+  Eigen::VectorXd q;
+  Eigen::VectorXd qd;
+  Eigen::VectorXd qdd;
+  Eigen::VectorXd tau;
+
+protected:
+  std::vector<std::shared_ptr<chrono::ChBody>> bodies;
+  std::vector<int> parents;
+  SpatialVector gravity;
+  // Root pose and per-link model in the initial configuration
+  Eigen::Matrix3d root_rotation;
+  Eigen::Vector3d root_position;
+  std::vector<Eigen::Matrix3d> tree_rotation;
+  std::vector<Eigen::Vector3d> tree_translation;
+  std::vector<Eigen::Vector3d> axis;
+  std::vector<Eigen::Vector3d> com;
+  std::vector<SpatialMatrix> inertia;
+  // Per-step quantities
+  std::vector<SpatialMatrix> transform;
+  std::vector<SpatialVector> velocity;
+  std::vector<SpatialVector> bias;
+  std::vector<SpatialMatrix> articulated_inertia;
+  std::vector<SpatialVector> articulated_force;
+  std::vector<SpatialVector> U;
+  std::vector<double> D;
+  std::vector<double> u;
+  std::vector<Eigen::Matrix3d> world_rotation;
+  std::vector<Eigen::Vector3d> world_position;
+
+  void kinematics(void);
+};
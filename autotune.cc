@@ -0,0 +1,172 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "solverlog.hh"
+#include "autotune.hh"
+
+static const struct {
+  chrono::ChTimestepper::Type type;
+  const char *name;
+} timesteppers[] = {
+  {chrono::ChTimestepper::Type::EULER_IMPLICIT_LINEARIZED, "EULER_IMPLICIT_LINEARIZED"},
+  {chrono::ChTimestepper::Type::EULER_IMPLICIT_PROJECTED, "EULER_IMPLICIT_PROJECTED"},
+  {chrono::ChTimestepper::Type::RUNGEKUTTA45, "RUNGEKUTTA45"}
+};
+
+static const struct {
+  chrono::ChSolver::Type type;
+  const char *name;
+} solvers[] = {
+  {chrono::ChSolver::Type::PSOR, "PSOR"},
+  {chrono::ChSolver::Type::BARZILAIBORWEIN, "BARZILAIBORWEIN"},
+  {chrono::ChSolver::Type::APGD, "APGD"}
+};
+
+static const int num_timesteppers = sizeof(timesteppers) / sizeof(timesteppers[0]);
+static const int num_solvers = sizeof(solvers) / sizeof(solvers[0]);
+
+static const char *timestepperName(chrono::ChTimestepper::Type type)
+{
+  for (int i=0; i<num_timesteppers; i++)
+    if (timesteppers[i].type == type)
+      return timesteppers[i].name;
+  return "unknown";
+}
+
+static const char *solverName(chrono::ChSolver::Type type)
+{
+  for (int i=0; i<num_solvers; i++)
+    if (solvers[i].type == type)
+      return solvers[i].name;
+  return "unknown";
+}
+
+void applyProfile(chrono::ChSystem &sys, const SolverProfile &profile, double tolerance)
+{
+  sys.SetTimestepperType(profile.timestepper);
+  sys.SetSolverType(profile.solver);
+  if (tolerance > 0.0) {
+    configureIterativeSolver(sys, profile.iterations, tolerance);
+    return;
+  };
+  auto solver = sys.GetSolver()->AsIterative();
+  if (solver)
+    solver->SetMaxIterations(profile.iterations);
+}
+
+bool loadProfile(const char *name, SolverProfile &profile)
+{
+  std::string filename = std::string(name) + ".profile";
+  FILE *file = fopen(filename.c_str(), "r");
+  if (!file)
+    return false;
+  char timestepper[64];
+  char solver[64];
+  int iterations;
+  bool result = fscanf(file, "timestepper %63s solver %63s iterations %d", timestepper, solver, &iterations) == 3;
+  fclose(file);
+  if (!result)
+    return false;
+  bool found_timestepper = false;
+  bool found_solver = false;
+  for (int i=0; i<num_timesteppers; i++)
+    if (!strcmp(timesteppers[i].name, timestepper)) {
+      profile.timestepper = timesteppers[i].type;
+      found_timestepper = true;
+    };
+  for (int i=0; i<num_solvers; i++)
+    if (!strcmp(solvers[i].name, solver)) {
+      profile.solver = solvers[i].type;
+      found_solver = true;
+    };
+  profile.iterations = iterations;
+  return found_timestepper && found_solver;
+}
+
+bool saveProfile(const char *name, const SolverProfile &profile)
+{
+  std::string filename = std::string(name) + ".profile";
+  FILE *file = fopen(filename.c_str(), "w");
+  if (!file) {
+    perror(filename.c_str());
+    return false;
+  };
+  fprintf(file, "timestepper %s\nsolver %s\niterations %d\n",
+          timestepperName(profile.timestepper), solverName(profile.solver), profile.iterations);
+  fclose(file);
+  return true;
+}
+
+bool useProfile(const char *name, chrono::ChSystem &sys, double tolerance, SolverProfile *result)
+{
+  SolverProfile profile;
+  if (!loadProfile(name, profile))
+    return false;
+  applyProfile(sys, profile, tolerance);
+  printf("%s.profile: %s, %s, %d iterations\n", name, timestepperName(profile.timestepper),
+         solverName(profile.solver), profile.iterations);
+  if (result)
+    *result = profile;
+  return true;
+}
+
+// Simulate the scene with the profile applied in the same way as when the scene loads it
+static double profileTrial(SceneFactory create, const SolverProfile &profile, double solver_tolerance, double dt,
+                           int steps, std::vector<chrono::ChVector3d> &positions)
+{
+  return trial([&]() {
+    Scene scene = create();
+    applyProfile(*scene.sys, profile, solver_tolerance);
+    return scene;
+  }, dt, steps, positions);
+}
+
+int autotune(const char *name, SceneFactory create, double dt, int steps, double tolerance, double solver_tolerance)
+{
+  int budgets[] = {10, 25, 50, 100};
+  SolverProfile reference_profile = {chrono::ChTimestepper::Type::EULER_IMPLICIT_LINEARIZED,
+                                     chrono::ChSolver::Type::BARZILAIBORWEIN, 500};
+  std::vector<chrono::ChVector3d> reference;
+  if (profileTrial(create, reference_profile, 0.0, dt / 10, steps * 10, reference) < 0) {
+    fprintf(stderr, "%s: reference run failed\n", name);
+    return 1;
+  };
+  printf("%-26s %-16s %10s %8s %9s\n", "timestepper", "solver", "iterations", "ms/step", "error");
+  SolverProfile best = reference_profile;
+  double best_time = INFINITY;
+  for (int i=0; i<num_timesteppers; i++)
+    for (int j=0; j<num_solvers; j++)
+      for (int k=0; k<4; k++) {
+        SolverProfile profile = {timesteppers[i].type, solvers[j].type, budgets[k]};
+        std::vector<chrono::ChVector3d> positions;
+        double step_time = profileTrial(create, profile, solver_tolerance, dt, steps, positions);
+        double error = step_time < 0 ? INFINITY : rmsError(positions, reference);
+        printf("%-26s %-16s %10d %8.3f %9.2e\n", timesteppers[i].name, solvers[j].name, budgets[k], step_time, error);
+        fflush(stdout);
+        if (error < tolerance && step_time < best_time) {
+          best = profile;
+          best_time = step_time;
+        };
+      };
+  if (std::isinf(best_time)) {
+    fprintf(stderr, "%s: no configuration is within the tolerance of %g\n", name, tolerance);
+    return 1;
+  };
+  if (!saveProfile(name, best))
+    return 1;
+  printf("%s.profile: %s, %s, %d iterations, %.3f ms/step\n", name, timestepperName(best.timestepper),
+         solverName(best.solver), best.iterations, best_time);
+  return 0;
+}
+
+bool autotuneOption(int argc, char *argv[], const char *name, SceneFactory create, double dt, int steps,
+                    double solver_tolerance)
+{
+  if (argc < 2 || strcmp(argv[1], "--autotune"))
+    return false;
+  autotune(name, create, dt, steps, argc > 2 ? atof(argv[2]) : 0.01, solver_tolerance);
+  return true;
+}
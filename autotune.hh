@@ -0,0 +1,35 @@
+#pragma once
+#include <chrono/physics/ChSystem.h>
+#include "scaling.hh"
+
+struct SolverProfile {
+  chrono::ChTimestepper::Type timestepper;
+  chrono::ChSolver::Type solver;
+  int iterations;
+};
+
+// Set timestepper, solver and iteration budget of the system.
+// Setting the solver replaces the solver object. Scenes which warm start their iterative solver with
+// configureIterativeSolver pass their tolerance so that warm start and early exit are kept (zero leaves both off).
+void applyProfile(chrono::ChSystem &sys, const SolverProfile &profile, double tolerance = 0.0);
+
+// Read and write the profile "<name>.profile" in the working directory
+bool loadProfile(const char *name, SolverProfile &profile);
+bool saveProfile(const char *name, const SolverProfile &profile);
+
+// Apply the profile of the scene to the system if there is one and return true in that case.
+// The profile is copied to "result" if it is not NULL.
+bool useProfile(const char *name, chrono::ChSystem &sys, double tolerance = 0.0, SolverProfile *result = NULL);
+
+// Run short headless trials of the scene with combinations of timesteppers, iterative solvers and iteration budgets.
+// The profile is applied with the scene's solver tolerance as it would be when the scene loads it.
+// Each trial is compared with a reference run using a ten times smaller step and a large iteration budget.
+// The error is the RMS distance between the final positions of the moving bodies.
+// The fastest configuration with an error below the tolerance is written to the scene's profile.
+int autotune(const char *name, SceneFactory create, double dt, int steps, double tolerance,
+             double solver_tolerance = 0.0);
+
+// Run the auto-tuner if the first command line argument is "--autotune" (optionally followed by the tolerance)
+// and return true in that case.
+bool autotuneOption(int argc, char *argv[], const char *name, SceneFactory create, double dt, int steps,
+                    double solver_tolerance = 0.0);
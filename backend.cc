@@ -0,0 +1,188 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <thread>
+#include <vector>
+#include <chrono/core/ChTimer.h>
+#include <chrono/physics/ChSystemNSC.h>
+#include <chrono/physics/ChSystemSMC.h>
+#include "backend.hh"
+
+std::shared_ptr<chrono::ChSystem> createContactSystem(chrono::ChContactMethod method)
+{
+  if (method == chrono::ChContactMethod::SMC)
+    return chrono_types::make_shared<chrono::ChSystemSMC>();
+  else
+    return chrono_types::make_shared<chrono::ChSystemNSC>();
+}
+
+std::shared_ptr<chrono::ChContactMaterial> createContactMaterial(chrono::ChContactMethod method)
+{
+  if (method != chrono::ChContactMethod::SMC)
+    return chrono_types::make_shared<chrono::ChContactMaterialNSC>();
+  auto material = chrono_types::make_shared<chrono::ChContactMaterialSMC>();
+  material->SetYoungModulus(1e+7f);
+  material->SetPoissonRatio(0.3f);
+  return material;
+}
+
+const char *contactMethodName(chrono::ChContactMethod method)
+{
+  return method == chrono::ChContactMethod::SMC ? "SMC" : "NSC";
+}
+
+chrono::ChContactMethod contactMethodOption(int argc, char *argv[])
+{
+  for (int i=1; i<argc; i++)
+    if (!strcmp(argv[i], "--smc"))
+      return chrono::ChContactMethod::SMC;
+  return chrono::ChContactMethod::NSC;
+}
+
+// Simulate the scene with the contact method and thread count
+static double backendTrial(BackendSceneFactory create, chrono::ChContactMethod method, int threads, double dt, int steps,
+                           std::vector<chrono::ChVector3d> &positions)
+{
+  return trial([&]() {
+    Scene scene = create(method);
+    scene.sys->SetNumThreads(threads, threads, threads);
+    return scene;
+  }, dt, steps, positions);
+}
+
+int compareBackends(const char *name, BackendSceneFactory create, double duration, double tolerance)
+{
+  double steps[] = {0.0005, 0.001, 0.002, 0.005, 0.01, 0.02, 0.05};
+  int num_steps = sizeof(steps) / sizeof(steps[0]);
+  int threads = std::thread::hardware_concurrency();
+  std::vector<chrono::ChVector3d> reference;
+  if (backendTrial(create, chrono::ChContactMethod::NSC, threads, 0.0005, (int)round(duration / 0.0005), reference) < 0) {
+    fprintf(stderr, "%s: reference run failed\n", name);
+    return 1;
+  };
+  printf("# %s, %g s, %d threads\n", name, duration, threads);
+  printf("backend dt      ms/step ms/second     error stable\n");
+  chrono::ChContactMethod methods[] = {chrono::ChContactMethod::NSC, chrono::ChContactMethod::SMC};
+  for (int i=0; i<2; i++) {
+    double largest = 0.0;
+    double largest_cost = INFINITY;
+    for (int j=0; j<num_steps; j++) {
+      double dt = steps[j];
+      int n = (int)round(duration / dt);
+      std::vector<chrono::ChVector3d> positions;
+      double step_time = backendTrial(create, methods[i], threads, dt, n, positions);
+      double error = step_time < 0 ? INFINITY : rmsError(positions, reference);
+      bool stable = error < tolerance;
+      if (stable) {
+        largest = dt;
+        largest_cost = step_time / dt;
+      };
+      printf("%-7s %-7g %7.3f %9.1f %9.2e %-6s\n", contactMethodName(methods[i]), dt, step_time, step_time / dt, error,
+             stable ? "yes" : "no");
+      fflush(stdout);
+    };
+    if (largest > 0.0)
+      printf("# largest stable step for %s: %g (%.1f ms per simulated second)\n", contactMethodName(methods[i]), largest,
+             largest_cost);
+    else
+      printf("# no stable step for %s\n", contactMethodName(methods[i]));
+  };
+  return 0;
+}
+
+bool backendOption(int argc, char *argv[], const char *name, BackendSceneFactory create, double duration)
+{
+  if (argc < 2 || strcmp(argv[1], "--backends"))
+    return false;
+  compareBackends(name, create, duration, argc > 2 ? atof(argv[2]) : 0.05);
+  return true;
+}
+
+const char *collisionSystemName(chrono::ChCollisionSystem::Type type)
+{
+  return type == chrono::ChCollisionSystem::Type::MULTICORE ? "multicore" : "bullet";
+}
+
+chrono::ChCollisionSystem::Type collisionSystemOption(int argc, char *argv[])
+{
+  for (int i=1; i<argc; i++)
+    if (!strcmp(argv[i], "--multicore"))
+      return chrono::ChCollisionSystem::Type::MULTICORE;
+  return chrono::ChCollisionSystem::Type::BULLET;
+}
+
+struct CollisionTiming {
+  int bodies;
+  double collision;
+  double broad;
+  double narrow;
+  double step;
+};
+
+// Accumulate Chrono's per step timers over the measured steps and return the averages in milliseconds.
+// Returns false if the simulation failed.
+static bool collisionTrial(CollisionSceneFactory create, chrono::ChCollisionSystem::Type type, int count, int threads,
+                           double dt, int warmup, int steps, CollisionTiming &result)
+{
+  result = CollisionTiming{0, 0.0, 0.0, 0.0, 0.0};
+  try {
+    Scene scene = create(type, count);
+    scene.sys->SetNumThreads(threads, threads, threads);
+    result.bodies = scene.sys->GetBodies().size();
+    for (int i=0; i<warmup+steps; i++) {
+      if (scene.update)
+        scene.update();
+      scene.sys->DoStepDynamics(dt);
+      if (i < warmup) continue;
+      result.collision += scene.sys->GetTimerCollision();
+      result.broad += scene.sys->GetTimerCollisionBroad();
+      result.narrow += scene.sys->GetTimerCollisionNarrow();
+      result.step += scene.sys->GetTimerStep();
+    };
+    result.collision *= 1000.0 / steps;
+    result.broad *= 1000.0 / steps;
+    result.narrow *= 1000.0 / steps;
+    result.step *= 1000.0 / steps;
+    return true;
+  } catch (std::exception &) {
+    return false;
+  };
+}
+
+int compareCollisionSystems(const char *name, CollisionSceneFactory create, int min_count, int max_count,
+                            double dt, int steps)
+{
+  int warmup = 50;
+  int threads = std::thread::hardware_concurrency();
+  chrono::ChCollisionSystem::Type types[] = {chrono::ChCollisionSystem::Type::BULLET,
+                                             chrono::ChCollisionSystem::Type::MULTICORE};
+  printf("# %s, %d threads\n", name, threads);
+  printf("count bodies system    collision   broad  narrow    step faster\n");
+  for (int count=min_count; count<=max_count; count*=2) {
+    CollisionTiming timing[2];
+    bool success[2];
+    for (int i=0; i<2; i++)
+      success[i] = collisionTrial(create, types[i], count, threads, dt, warmup, steps, timing[i]);
+    int faster = !success[1] || (success[0] && timing[0].collision <= timing[1].collision) ? 0 : 1;
+    for (int i=0; i<2; i++) {
+      if (success[i])
+        printf("%5d %6d %-9s %9.3f %7.3f %7.3f %7.3f %s\n", count, timing[i].bodies, collisionSystemName(types[i]),
+               timing[i].collision, timing[i].broad, timing[i].narrow, timing[i].step, i == faster ? "*" : "");
+      else
+        printf("%5d %6s %-9s failed\n", count, "", collisionSystemName(types[i]));
+    };
+    fflush(stdout);
+  };
+  return 0;
+}
+
+bool collisionOption(int argc, char *argv[], const char *name, CollisionSceneFactory create, int min_count,
+                     int max_count, double dt, int steps)
+{
+  if (argc < 2 || strcmp(argv[1], "--collision"))
+    return false;
+  compareCollisionSystems(name, create, min_count, argc > 2 ? atoi(argv[2]) : max_count, dt, steps);
+  return true;
+}
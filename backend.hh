@@ -0,0 +1,48 @@
+#pragma once
+#include <functional>
+#include <memory>
+#include <chrono/physics/ChSystem.h>
+#include "scaling.hh"
+
+// Empty system using complementarity (NSC) or penalty (SMC) contacts
+std::shared_ptr<chrono::ChSystem> createContactSystem(chrono::ChContactMethod method);
+
+// Contact material for the contact method. SMC materials get a Young's modulus which keeps the penetration of
+// the scenes small. Friction and restitution are left to the scene.
+std::shared_ptr<chrono::ChContactMaterial> createContactMaterial(chrono::ChContactMethod method);
+
+const char *contactMethodName(chrono::ChContactMethod method);
+
+// Contact method selected with "--smc" on the command line (NSC otherwise)
+chrono::ChContactMethod contactMethodOption(int argc, char *argv[]);
+
+typedef std::function<Scene(chrono::ChContactMethod method)> BackendSceneFactory;
+
+// Simulate the scene for the given duration on both contact backends with a range of step sizes using all hardware threads.
+// Each run is compared with an NSC reference run using a step of 0.5 ms.
+// A step is stable if the RMS distance of the final positions of the moving bodies to the reference is below the tolerance.
+// The step time, the wall clock time per simulated second, the error and the largest stable step of each backend are printed.
+int compareBackends(const char *name, BackendSceneFactory create, double duration, double tolerance);
+
+// Run the backend comparison if the first command line argument is "--backends" (optionally followed by the tolerance)
+// and return true in that case.
+bool backendOption(int argc, char *argv[], const char *name, BackendSceneFactory create, double duration);
+
+const char *collisionSystemName(chrono::ChCollisionSystem::Type type);
+
+// Collision system selected with "--multicore" on the command line (Bullet otherwise)
+chrono::ChCollisionSystem::Type collisionSystemOption(int argc, char *argv[]);
+
+// Scene of the given size (number of bodies, vehicles, ...) using the given collision system
+typedef std::function<Scene(chrono::ChCollisionSystem::Type type, int count)> CollisionSceneFactory;
+
+// Step scenes of doubling size with Bullet and with Chrono's multicore collision system using all hardware threads.
+// The collision time (broadphase plus narrowphase) and the total step time per step are printed
+// together with the faster collision system for each size.
+int compareCollisionSystems(const char *name, CollisionSceneFactory create, int min_count, int max_count,
+                            double dt, int steps);
+
+// Run the collision system comparison if the first command line argument is "--collision"
+// (optionally followed by the largest size) and return true in that case.
+bool collisionOption(int argc, char *argv[], const char *name, CollisionSceneFactory create, int min_count,
+                     int max_count, double dt, int steps);
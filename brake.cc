@@ -0,0 +1,41 @@
+#include "brake.hh"
+
+BrakeFunction::BrakeFunction(std::shared_ptr<chrono::ChLinkMotorRotationTorque> motor, double braking, bool smooth):
+  motor(motor), braking(braking), smooth(smooth), regularisation(brake_regularisation), stribeck(brake_stribeck),
+  static_factor(brake_static_factor)
+{
+}
+
+double BrakeFunction::GetVal(double x) const
+{
+  double w = motor->GetMotorAngleDt();
+  if (smooth)
+    return brakeTorque(w, braking, regularisation, stribeck, static_factor);
+  if (w > 0.005)
+    return -braking;
+  else if (w < -0.005)
+    return braking;
+  else
+    return 0.0;
+}
+
+BrakeEvents::BrakeEvents(void):
+  events(0)
+{
+}
+
+void BrakeEvents::add(std::shared_ptr<chrono::ChLinkMotorRotationTorque> motor)
+{
+  motors.push_back(motor);
+  previous.push_back(motor->GetMotorAngleDt());
+}
+
+void BrakeEvents::update(void)
+{
+  for (unsigned int i=0; i<motors.size(); i++) {
+    double w = motors[i]->GetMotorAngleDt();
+    if ((w > 0.0 && previous[i] < 0.0) || (w < 0.0 && previous[i] > 0.0))
+      events++;
+    previous[i] = w;
+  };
+}
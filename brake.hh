@@ -0,0 +1,37 @@
+#pragma once
+#include <memory>
+#include <vector>
+#include <chrono/physics/ChLinkMotorRotationTorque.h>
+#include "brakelaw.hh"
+
+// Brake torque for a torque motor using either the regularised law or
+// a switching law (full torque above 0.005 rad/s, none below).
+class BrakeFunction: public chrono::ChFunction {
+public:
+  BrakeFunction(std::shared_ptr<chrono::ChLinkMotorRotationTorque> motor, double braking, bool smooth);
+
+  virtual BrakeFunction* Clone() const override { return new BrakeFunction(*this); }
+  virtual double GetVal(double x) const override;
+
+  std::shared_ptr<chrono::ChLinkMotorRotationTorque> motor;
+  double braking;
+  bool smooth;
+  double regularisation;
+  double stribeck;
+  double static_factor;
+};
+
+// Detection of sign changes of the motor speeds between steps. With the switching brake law a stopped wheel
+// reverses at almost every step, so the event rate measures the chatter.
+class BrakeEvents {
+public:
+  BrakeEvents(void);
+
+  void add(std::shared_ptr<chrono::ChLinkMotorRotationTorque> motor);
+  // Compare the motor speeds with the ones of the previous call and count the sign changes
+  void update(void);
+
+  std::vector<std::shared_ptr<chrono::ChLinkMotorRotationTorque>> motors;
+  std::vector<double> previous;
+  long events;
+};
@@ -0,0 +1,10 @@
+#include "brakelaw.hh"
+
+// This file is compiled with -ffast-math (see Makefile) and must not include Chrono or Eigen headers,
+// so that no inline functions shared with other object files are compiled with different floating point semantics.
+void brakeLaw(int n, const double *speeds, const double *braking, double *torques)
+{
+  #pragma omp simd
+  for (int i=0; i<n; i++)
+    torques[i] = brakeTorque(speeds[i], braking[i], brake_regularisation, brake_stribeck, brake_static_factor);
+}
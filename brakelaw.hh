@@ -0,0 +1,23 @@
+#pragma once
+#include <cmath>
+
+// Default parameters of the regularised brake law
+const double brake_regularisation = 0.05;
+const double brake_stribeck = 0.1;
+const double brake_static_factor = 1.2;
+
+// Regularised brake law. The torque opposes the speed w and follows a Stribeck curve with a static peak
+// of "static_factor" times the kinetic torque "braking", decaying over "stribeck" rad/s.
+// The tanh replaces the sign function around zero speed with a slope of about static_factor * braking / regularisation,
+// so a stopped wheel creeps at a fraction of "regularisation" instead of switching between positive and negative torque.
+// It is defined inline so that the loop of brakeLaw can be vectorised, and static so that the fast math copy
+// in brakelaw.o is never shared with other object files.
+static inline double brakeTorque(double w, double braking, double regularisation, double stribeck, double static_factor)
+{
+  double peak = (static_factor - 1.0) * exp(-(w * w) / (stribeck * stribeck));
+  return -tanh(w / regularisation) * braking * (1.0 + peak);
+}
+
+// Regularised brake law with the default parameters for all motors of a MotorBank.
+// The parameters are the kinetic brake torques of the motors.
+void brakeLaw(int n, const double *speeds, const double *braking, double *torques);
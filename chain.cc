@@ -0,0 +1,373 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include <chrono/core/ChQuaternion.h>
+#include <chrono/core/ChTimer.h>
+#include <chrono/physics/ChBody.h>
+#include <chrono/physics/ChSystemNSC.h>
+#include <chrono/physics/ChLinkRevolute.h>
+#include <chrono/solver/ChDirectSolverLS.h>
+#include "renderer.hh"
+#include "aba.hh"
+#include "scaling.hh"
+#include "autotune.hh"
+
+int width = 1280;
+int height = 720;
+
+// The chain has a fixed total length and mass which are distributed over the links
+const double chain_length = 1.0;
+const double chain_mass = 10.0;
+const double b = 0.02;
+const double c = 0.02;
+
+const char *vertexSource = "#version 410 core\n" GLOBALS_BLOCK "\
+uniform vec3 axes;\n\
+uniform vec3 translation;\n\
+uniform mat3 rotation;\n\
+in vec3 point;\n\
+in vec3 normal;\n\
+out vec3 n;\n\
+void main()\n\
+{\n\
+  n = rotation * normal;\n\
+  gl_Position = vec4((rotation * (point * axes) + translation) * vec3(1, aspect, 1), 1);\n\
+}";
+
+const char *fragmentSource = "#version 410 core\n" GLOBALS_BLOCK "\
+in vec3 n;\n\
+out vec3 fragColor;\n\
+void main()\n\
+{\n\
+  float ambient = 0.3;\n\
+  float diffuse = 0.7 * max(dot(light, n), 0);\n\
+  fragColor = vec3(1, 1, 1) * (ambient + diffuse);\n\
+}";
+
+// Vertex array data
+GLfloat vertices[] = {
+  // Front face
+  -0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f,
+   0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f,
+   0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f,
+  -0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f,
+
+  // Back face
+  -0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
+   0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
+   0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
+  -0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
+
+  // Left face
+  -0.5f, -0.5f,  0.5f, -1.0f,  0.0f,  0.0f,
+  -0.5f,  0.5f,  0.5f, -1.0f,  0.0f,  0.0f,
+  -0.5f,  0.5f, -0.5f, -1.0f,  0.0f,  0.0f,
+  -0.5f, -0.5f, -0.5f, -1.0f,  0.0f,  0.0f,
+
+  // Right face
+   0.5f, -0.5f,  0.5f,  1.0f,  0.0f,  0.0f,
+   0.5f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f,
+   0.5f,  0.5f, -0.5f,  1.0f,  0.0f,  0.0f,
+   0.5f, -0.5f, -0.5f,  1.0f,  0.0f,  0.0f,
+
+  // Top face
+  -0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,
+   0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,
+   0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,
+  -0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,
+
+  // Bottom face
+  -0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,
+   0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,
+   0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,
+  -0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f
+};
+
+unsigned int indices[] = {
+   0,  1,  2,  3,
+   4,  5,  6,  7,
+   8,  9, 10, 11,
+  12, 13, 14, 15,
+  16, 17, 18, 19,
+  20, 21, 22, 23
+};
+
+void setupSystem(chrono::ChSystemNSC &sys, const char *solver)
+{
+  sys.SetTimestepperType(chrono::ChTimestepper::Type::EULER_IMPLICIT_PROJECTED);
+  if (!strcmp(solver, "lu")) {
+    auto lu = chrono_types::make_shared<chrono::ChSolverSparseLU>();
+    lu->UseSparsityPatternLearner(true);
+    lu->LockSparsityPattern(true);
+    sys.SetSolver(lu);
+  } else if (!strcmp(solver, "qr")) {
+    auto qr = chrono_types::make_shared<chrono::ChSolverSparseQR>();
+    qr->UseSparsityPatternLearner(true);
+    qr->LockSparsityPattern(true);
+    sys.SetSolver(qr);
+  } else {
+    sys.SetSolverType(chrono::ChSolver::Type::PSOR);
+    sys.GetSolver()->AsIterative()->SetMaxIterations(100);
+  };
+  sys.SetGravitationalAcceleration(chrono::ChVector3(0.0, -0.4, 0.0));
+}
+
+struct Chain {
+  std::shared_ptr<chrono::ChBody> base;
+  std::vector<std::shared_ptr<chrono::ChBody>> links;
+  std::vector<std::shared_ptr<chrono::ChLinkRevolute>> joints;
+};
+
+// Chain of cuboids connected with revolute joints about the z axis, starting horizontally from a fixed base
+Chain addChain(chrono::ChSystemNSC &sys, int num_links)
+{
+  Chain chain;
+  double a = chain_length / num_links;
+  double mass = chain_mass / num_links;
+
+  auto base = chrono_types::make_shared<chrono::ChBody>();
+  base->SetFixed(true);
+  base->SetMass(10.0);
+  base->SetInertiaXX(chrono::ChVector3(1, 1, 1));
+  base->SetPos(chrono::ChVector3(-0.5 * chain_length, 0.5, 0.0));
+  sys.AddBody(base);
+  chain.base = base;
+
+  std::shared_ptr<chrono::ChBody> parent = base;
+  for (int i=0; i<num_links; i++) {
+    chrono::ChVector3d joint = base->GetPos() + chrono::ChVector3d(i * a, 0.0, 0.0);
+    auto link = chrono_types::make_shared<chrono::ChBody>();
+    link->SetMass(mass);
+    link->SetInertiaXX(chrono::ChVector3(mass * (b * b + c * c) / 12.0,
+                                         mass * (a * a + c * c) / 12.0,
+                                         mass * (a * a + b * b) / 12.0));
+    link->SetPos(joint + chrono::ChVector3d(0.5 * a, 0.0, 0.0));
+    sys.AddBody(link);
+    chain.links.push_back(link);
+
+    auto revolute = chrono_types::make_shared<chrono::ChLinkRevolute>();
+    revolute->Initialize(parent, link, chrono::ChFrame<>(joint, chrono::QUNIT));
+    sys.AddLink(revolute);
+    chain.joints.push_back(revolute);
+    parent = link;
+  };
+  return chain;
+}
+
+// Largest distance between the end of a link and the start of the next one
+double chainDrift(const Chain &chain)
+{
+  double a = chain_length / chain.links.size();
+  double result = 0.0;
+  chrono::ChVector3d end = chain.base->GetPos();
+  for (auto link=chain.links.begin(); link!=chain.links.end(); link++) {
+    chrono::ChVector3d start = (*link)->TransformPointLocalToParent(chrono::ChVector3d(-0.5 * a, 0.0, 0.0));
+    result = fmax(result, (start - end).Length());
+    end = (*link)->TransformPointLocalToParent(chrono::ChVector3d(0.5 * a, 0.0, 0.0));
+  };
+  return result;
+}
+
+// Reduced-coordinate model of the chain for the articulated-body fast path
+ArticulatedBody *createArticulatedBody(chrono::ChSystemNSC &sys, const Chain &chain)
+{
+  std::vector<int> parents;
+  for (unsigned int i=0; i<chain.links.size(); i++)
+    parents.push_back((int)i - 1);
+  return new ArticulatedBody(chain.base, chain.links, chain.joints, parents, sys.GetGravitationalAcceleration());
+}
+
+Scene createScene(void)
+{
+  auto sys = chrono_types::make_shared<chrono::ChSystemNSC>();
+  setupSystem(*sys, "psor");
+  addChain(*sys, 100);
+  return Scene{sys};
+}
+
+// Compare cost per step and joint drift of the iterative and the sparse direct solvers and of the articulated-body
+// algorithm for increasing chain lengths
+int benchmark(void)
+{
+  int sizes[] = {10, 30, 100, 300, 1000};
+  const char *solvers[] = {"psor", "lu", "qr", "aba"};
+  double dt = 0.005;
+  int steps = 200;
+  printf("links solver ms/step steps/s max_drift final_drift\n");
+  for (int i=0; i<5; i++) {
+    for (int j=0; j<4; j++) {
+      chrono::ChSystemNSC sys;
+      setupSystem(sys, solvers[j]);
+      Chain chain = addChain(sys, sizes[i]);
+      ArticulatedBody *aba = strcmp(solvers[j], "aba") ? NULL : createArticulatedBody(sys, chain);
+      double max_drift = 0.0;
+      chrono::ChTimer timer;
+      for (int k=0; k<steps; k++) {
+        timer.start();
+        if (aba)
+          aba->step(dt);
+        else
+          sys.DoStepDynamics(dt);
+        timer.stop();
+        if (aba)
+          aba->apply();
+        max_drift = fmax(max_drift, chainDrift(chain));
+      };
+      double step_time = 1000.0 * timer.GetTimeSeconds() / steps;
+      printf("%5d %-6s %7.3f %7.0f %9.2e %11.2e\n", sizes[i], solvers[j], step_time, 1000.0 / step_time,
+             max_drift, chainDrift(chain));
+      delete aba;
+      fflush(stdout);
+    };
+  };
+  return 0;
+}
+
+// Run the chain with Chrono and with the articulated-body algorithm side by side and print the largest
+// distance between corresponding link centers
+int validate(int num_links, double duration)
+{
+  double dt = 0.001;
+  chrono::ChSystemNSC sys;
+  setupSystem(sys, "lu");
+  Chain chain = addChain(sys, num_links);
+  chrono::ChSystemNSC model_sys;
+  setupSystem(model_sys, "lu");
+  Chain model = addChain(model_sys, num_links);
+  ArticulatedBody *aba = createArticulatedBody(model_sys, model);
+  printf("time deviation chrono_drift\n");
+  int steps = (int)round(duration / dt);
+  for (int k=1; k<=steps; k++) {
+    sys.DoStepDynamics(dt);
+    aba->step(dt);
+    if (k % 100 == 0) {
+      double deviation = 0.0;
+      for (int i=0; i<num_links; i++)
+        deviation = fmax(deviation, (chain.links[i]->GetPos() - aba->position(i)).Length());
+      printf("%4.1f %9.2e %12.2e\n", k * dt, deviation, chainDrift(chain));
+    };
+  };
+  delete aba;
+  return 0;
+}
+
+int main(int argc, char *argv[])
+{
+  if (scalingOption(argc, argv, "chain", createScene, 0.005, 500))
+    return 0;
+  if (autotuneOption(argc, argv, "chain", createScene, 0.005, 200))
+    return 0;
+  if (argc > 1 && !strcmp(argv[1], "--benchmark"))
+    return benchmark();
+  // The number of links follows "--validate" or is the first argument
+  bool validation = argc > 1 && !strcmp(argv[1], "--validate");
+  int links_argument = validation ? 2 : 1;
+  int num_links = argc > links_argument ? atoi(argv[links_argument]) : 10;
+  // The scene's profile is only used if no solver is given on the command line
+  const char *solver = !validation && argc > 2 ? argv[2] : NULL;
+  bool known_solver = !solver || !strcmp(solver, "psor") || !strcmp(solver, "lu") || !strcmp(solver, "qr") ||
+                      !strcmp(solver, "aba");
+  if (num_links < 1 || !known_solver) {
+    fprintf(stderr, "Usage: %s [links] [psor|lu|qr|aba] or %s --validate [links] [duration] (at least 1 link)\n",
+            argv[0], argv[0]);
+    return 1;
+  };
+  if (validation)
+    return validate(num_links, argc > 3 ? atof(argv[3]) : 5.0);
+
+  glfwInit();
+  GLFWwindow *window = glfwCreateWindow(width, height, "Pendulum chain with Project Chrono", NULL, NULL);
+  glfwMakeContextCurrent(window);
+  glewInit();
+
+  glClearColor(0.1f, 0.1f, 0.1f, 0.0f);
+  glViewport(0, 0, width, height);
+
+  Program program = createProgram(vertexSource, fragmentSource);
+
+  GLuint vao;
+  GLuint vbo;
+  GLuint idx;
+
+  glGenVertexArrays(1, &vao);
+  glBindVertexArray(vao);
+
+  glGenBuffers(1, &vbo);
+  glBindBuffer(GL_ARRAY_BUFFER, vbo);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+  glGenBuffers(1, &idx);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, idx);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+
+  glUseProgram(program.program);
+
+  glVertexAttribPointer(glGetAttribLocation(program.program, "point"),
+                        3, GL_FLOAT, GL_FALSE,
+                        6 * sizeof(float), (void *)0);
+  glVertexAttribPointer(glGetAttribLocation(program.program, "normal"),
+                        3, GL_FLOAT, GL_FALSE,
+                        6 * sizeof(float), (void *)(3 * sizeof(float)));
+
+  glEnableVertexAttribArray(0);
+  glEnableVertexAttribArray(1);
+
+  glDisable(GL_CULL_FACE);
+  glEnable(GL_DEPTH_TEST);
+
+  float light[3] = {0.36f, 0.8f, -0.48f};
+  GLuint globals = createGlobals();
+  attachGlobals(program);
+  updateGlobals(globals, (float)width / (float)height, light);
+  float axes[3] = {(float)(chain_length / num_links), (float)b, (float)c};
+  glUniform3fv(program.axes, 1, axes);
+
+  chrono::ChSystemNSC sys;
+  setupSystem(sys, solver ? solver : "psor");
+  if (!solver)
+    useProfile("chain", sys);
+  Chain chain = addChain(sys, num_links);
+  ArticulatedBody *aba = solver && !strcmp(solver, "aba") ? createArticulatedBody(sys, chain) : NULL;
+
+  DrawList draws;
+
+  double t = glfwGetTime();
+  while (!glfwWindowShouldClose(window)) {
+    double dt = glfwGetTime() - t;
+    if (dt > 0.02) dt = 0.02;
+
+    glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
+
+    draws.clear();
+    for (auto link=chain.links.begin(); link!=chain.links.end(); link++)
+      draws.add(program, vao, GL_QUADS, 24, **link);
+    draws.submit();
+
+    glfwSwapBuffers(window);
+    glfwPollEvents();
+    if (aba) {
+      aba->step(dt);
+      aba->apply();
+    } else
+      sys.DoStepDynamics(dt);
+    t += dt;
+  };
+
+  delete aba;
+
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+  glDeleteBuffers(1, &idx);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glDeleteBuffers(1, &vbo);
+  glBindVertexArray(0);
+  glDeleteVertexArrays(1, &vao);
+
+  deleteGlobals(globals);
+  deleteProgram(program);
+
+  glfwTerminate();
+  return 0;
+}
@@ -0,0 +1,165 @@
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <chrono/core/ChTimer.h>
+#include "conservation.hh"
+
+ConservationMonitor::ConservationMonitor(chrono::ChSystem &sys, PotentialEnergy potential_energy,
+                                         double energy_threshold, double momentum_threshold):
+  sys(sys), potential_energy(potential_energy), energy_threshold(energy_threshold), momentum_threshold(momentum_threshold),
+  file(NULL), kinetic(0.0), potential(0.0), momentum(0, 0, 0), energy_drift(0.0), momentum_drift(0.0),
+  max_energy_drift(0.0), max_momentum_drift(0.0), energy_flagged(false), momentum_flagged(false), verbose(true)
+{
+  for (auto body=sys.GetBodies().begin(); body!=sys.GetBodies().end(); body++)
+    if (!(*body)->IsFixed())
+      bodies.push_back(*body);
+  compute();
+  initial_energy = kinetic + potential;
+  initial_momentum = momentum;
+}
+
+ConservationMonitor::~ConservationMonitor()
+{
+  if (file)
+    fclose(file);
+  if (verbose)
+    printf("conservation: largest relative drift of energy %.2e, of angular momentum %.2e\n",
+           max_energy_drift, max_momentum_drift);
+}
+
+bool ConservationMonitor::open(const char *filename)
+{
+  file = fopen(filename, "w");
+  if (!file) {
+    perror(filename);
+    return false;
+  };
+  fprintf(file, "time kinetic potential energy Lx Ly Lz energy_drift momentum_drift\n");
+  return true;
+}
+
+void ConservationMonitor::compute(void)
+{
+  kinetic = 0.0;
+  potential = 0.0;
+  momentum = chrono::ChVector3d(0, 0, 0);
+  for (auto body=bodies.begin(); body!=bodies.end(); body++) {
+    const chrono::ChBody &rigid = **body;
+    double mass = rigid.GetMass();
+    chrono::ChVector3d velocity = rigid.GetPosDt();
+    chrono::ChVector3d omega = rigid.GetAngVelLocal();
+    chrono::ChVector3d diagonal = rigid.GetInertiaXX();
+    chrono::ChVector3d products = rigid.GetInertiaXY();
+    // Angular momentum in body coordinates using the inertia tensor (Ixy, Ixz, Iyz off the diagonal)
+    chrono::ChVector3d spin(diagonal.x() * omega.x() + products.x() * omega.y() + products.y() * omega.z(),
+                            products.x() * omega.x() + diagonal.y() * omega.y() + products.z() * omega.z(),
+                            products.y() * omega.x() + products.z() * omega.y() + diagonal.z() * omega.z());
+    kinetic += 0.5 * mass * velocity.Length2() + 0.5 * (omega ^ spin);
+    if (potential_energy)
+      potential += potential_energy(rigid);
+    momentum += rigid.GetPos().Cross(velocity * mass) + rigid.GetRot().Rotate(spin);
+  };
+}
+
+void ConservationMonitor::update(void)
+{
+  compute();
+  double energy = kinetic + potential;
+  double energy_scale = fabs(initial_energy) > 1e-12 ? fabs(initial_energy) : 1.0;
+  double momentum_scale = initial_momentum.Length() > 1e-12 ? initial_momentum.Length() : 1.0;
+  energy_drift = fabs(energy - initial_energy) / energy_scale;
+  momentum_drift = (momentum - initial_momentum).Length() / momentum_scale;
+  if (energy_drift > max_energy_drift)
+    max_energy_drift = energy_drift;
+  if (momentum_drift > max_momentum_drift)
+    max_momentum_drift = momentum_drift;
+  if (!energy_flagged && energy_drift > energy_threshold) {
+    if (verbose)
+      printf("conservation: energy drifted by %.2e at t = %g\n", energy_drift, sys.GetChTime());
+    energy_flagged = true;
+  };
+  if (!momentum_flagged && momentum_drift > momentum_threshold) {
+    if (verbose)
+      printf("conservation: angular momentum drifted by %.2e at t = %g\n", momentum_drift, sys.GetChTime());
+    momentum_flagged = true;
+  };
+  if (file)
+    fprintf(file, "%g %g %g %g %g %g %g %g %g\n", sys.GetChTime(), kinetic, potential, energy,
+            momentum.x(), momentum.y(), momentum.z(), energy_drift, momentum_drift);
+}
+
+int driftReport(const char *name, SceneFactory create, PotentialEnergy potential, double duration,
+                double energy_threshold, double momentum_threshold)
+{
+  double steps[] = {0.001, 0.002, 0.005, 0.01, 0.02, 0.05, 0.1};
+  printf("# %s, %g s, thresholds %g (energy) and %g (angular momentum)\n", name, duration, energy_threshold,
+         momentum_threshold);
+  printf("dt     ms/step energy_drift momentum_drift within\n");
+  double largest = 0.0;
+  for (int i=0; i<7; i++) {
+    double dt = steps[i];
+    int n = (int)round(duration / dt);
+    double step_time = -1.0;
+    double energy_drift = INFINITY;
+    double momentum_drift = INFINITY;
+    try {
+      Scene scene = create();
+      ConservationMonitor monitor(*scene.sys, potential, energy_threshold, momentum_threshold);
+      monitor.verbose = false;
+      chrono::ChTimer timer;
+      for (int k=0; k<n; k++) {
+        if (scene.update)
+          scene.update();
+        timer.start();
+        scene.sys->DoStepDynamics(dt);
+        timer.stop();
+        monitor.update();
+      };
+      step_time = 1000.0 * timer.GetTimeSeconds() / n;
+      energy_drift = monitor.max_energy_drift;
+      momentum_drift = monitor.max_momentum_drift;
+    } catch (std::exception &) {
+    };
+    bool within = energy_drift <= energy_threshold && momentum_drift <= momentum_threshold;
+    if (within)
+      largest = dt;
+    printf("%-6g %7.3f %12.2e %14.2e %-6s\n", dt, step_time, energy_drift, momentum_drift, within ? "yes" : "no");
+    fflush(stdout);
+  };
+  if (largest > 0.0)
+    printf("# largest step within the thresholds: %g\n", largest);
+  else
+    printf("# no step within the thresholds\n");
+  return 0;
+}
+
+bool driftOption(int argc, char *argv[], const char *name, SceneFactory create, PotentialEnergy potential,
+                 double energy_threshold, double momentum_threshold)
+{
+  if (argc < 2 || strcmp(argv[1], "--drift"))
+    return false;
+  driftReport(name, create, potential, argc > 2 ? atof(argv[2]) : 60.0, energy_threshold, momentum_threshold);
+  return true;
+}
+
+ConservationMonitor *conservationOption(int argc, char *argv[], chrono::ChSystem &sys, PotentialEnergy potential,
+                                        double energy_threshold, double momentum_threshold)
+{
+  const char *filename = NULL;
+  bool enabled = false;
+  for (int i=1; i<argc; i++) {
+    if (!strcmp(argv[i], "--conservation"))
+      enabled = true;
+    if (!strcmp(argv[i], "--conservation-log") && i + 1 < argc) {
+      enabled = true;
+      filename = argv[i + 1];
+    };
+  };
+  if (!enabled)
+    return NULL;
+  ConservationMonitor *monitor = new ConservationMonitor(sys, potential, energy_threshold, momentum_threshold);
+  if (filename)
+    monitor->open(filename);
+  return monitor;
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <chrono/physics/ChBody.h>
+#include <chrono/physics/ChSystem.h>
+#include "scaling.hh"
+
+// Potential energy of a body, e.g. in a central force field. Without it only kinetic energy is counted.
+typedef std::function<double(const chrono::ChBody &body)> PotentialEnergy;
+
+// Energy and angular momentum monitor for conservative scenes.
+// The movable bodies are collected once when the monitor is created and after each step the kinetic energy,
+// the potential energy and the angular momentum about the origin are summed over them.
+// Only the largest drift relative to the initial values is kept. A warning is printed the first time
+// the relative drift of the energy or of the angular momentum exceeds its threshold.
+class ConservationMonitor {
+public:
+  ConservationMonitor(chrono::ChSystem &sys, PotentialEnergy potential_energy, double energy_threshold,
+                      double momentum_threshold);
+  ~ConservationMonitor();
+
+  // Write a line "time kinetic potential energy Lx Ly Lz energy_drift momentum_drift" per update to the file
+  bool open(const char *filename);
+  // Compute the totals after a step
+  void update(void);
+
+  chrono::ChSystem &sys;
+  PotentialEnergy potential_energy;
+  double energy_threshold;
+  double momentum_threshold;
+  std::vector<std::shared_ptr<chrono::ChBody>> bodies;
+  FILE *file;
+  double kinetic;
+  double potential;
+  chrono::ChVector3d momentum;
+  double initial_energy;
+  chrono::ChVector3d initial_momentum;
+  double energy_drift;
+  double momentum_drift;
+  double max_energy_drift;
+  double max_momentum_drift;
+  bool energy_flagged;
+  bool momentum_flagged;
+  // Print the warnings and a summary when the monitor is destroyed
+  bool verbose;
+
+protected:
+  void compute(void);
+};
+
+// Simulate the scene with step sizes from 1 ms to 100 ms and print the step time and the largest relative drift
+// of energy and angular momentum together with the largest step within both thresholds.
+int driftReport(const char *name, SceneFactory create, PotentialEnergy potential, double duration,
+                double energy_threshold, double momentum_threshold);
+
+// Run the drift report if the first command line argument is "--drift" (optionally followed by the duration)
+// and return true in that case.
+bool driftOption(int argc, char *argv[], const char *name, SceneFactory create, PotentialEnergy potential,
+                 double energy_threshold, double momentum_threshold);
+
+// Create a monitor if "--conservation" or "--conservation-log <file>" is given on the command line, otherwise return NULL
+ConservationMonitor *conservationOption(int argc, char *argv[], chrono::ChSystem &sys, PotentialEnergy potential,
+                                        double energy_threshold, double momentum_threshold);
@@ -0,0 +1,66 @@
+#include <cmath>
+#include "contact.hh"
+
+WheelContact::WheelContact(const Terrain &terrain, const FloatingOrigin &origin, double stiffness, double damping,
+                           double friction):
+  terrain(terrain), origin(origin), stiffness(stiffness), damping(damping), friction(friction), slip_velocity(0.01),
+  num_contacts(0)
+{
+}
+
+void WheelContact::add(std::shared_ptr<chrono::ChBody> wheel, double radius, double length)
+{
+  wheels.push_back(Wheel{wheel, radius, length});
+}
+
+void WheelContact::update(double dt)
+{
+  num_contacts = 0;
+  for (auto wheel=wheels.begin(); wheel!=wheels.end(); wheel++) {
+    chrono::ChBody &body = *wheel->body;
+    body.EmptyAccumulators();
+    chrono::ChVector3d center = body.GetPos();
+
+    // Road plane below the wheel center in local coordinates
+    double x = center.x() + origin.origin.x();
+    double e = 1e-3;
+    double slope = (terrain.height(x + e) - terrain.height(x - e)) / (2 * e);
+    chrono::ChVector3d normal = chrono::ChVector3d(-slope, 1.0, 0.0) / sqrt(1.0 + slope * slope);
+
+    // Deepest point of the rims: move towards the road within the wheel plane and towards the lower rim along the axis
+    chrono::ChVector3d axis = body.TransformDirectionLocalToParent(chrono::ChVector3d(0.0, 0.0, 1.0));
+    double cos_axis = normal.Dot(axis);
+    chrono::ChVector3d radial = normal - axis * cos_axis;
+    double radial_length = radial.Length();
+    if (radial_length < 1e-6) continue;
+    chrono::ChVector3d point = center - radial * (wheel->radius / radial_length) -
+                               axis * (cos_axis > 0 ? 0.5 * wheel->length : -0.5 * wheel->length);
+    double ground = terrain.height(point.x() + origin.origin.x()) - origin.origin.y();
+    double penetration = (ground - point.y()) * normal.y();
+    if (penetration <= 0.0) continue;
+
+    chrono::ChVector3d velocity = body.GetPosDt() + body.GetAngVelParent().Cross(point - center);
+    double normal_velocity = velocity.Dot(normal);
+    double normal_force = stiffness * penetration - damping * normal_velocity;
+    if (normal_force <= 0.0) continue;
+    chrono::ChVector3d tangential_velocity = velocity - normal * normal_velocity;
+    double speed = tangential_velocity.Length();
+    chrono::ChVector3d force = normal * normal_force;
+    if (speed > 0.0) {
+      chrono::ChVector3d direction = tangential_velocity / speed;
+      double friction_force = friction * normal_force * speed / sqrt(speed * speed + slip_velocity * slip_velocity);
+      // The force is held constant over the step, and near zero slip the regularised law is too stiff for that:
+      // the slip would overshoot and change sign every step. The friction impulse is therefore clamped to the one
+      // stopping the slip within the step. The effective mass is the one of the free wheel at the contact point
+      // (inertia diagonal in body coordinates). Joints only make the wheel heavier, so the clamp is conservative.
+      chrono::ChVector3d lever = body.GetRot().RotateBack((point - center).Cross(direction));
+      chrono::ChVector3d inertia = body.GetInertiaXX();
+      double inverse_mass = 1.0 / body.GetMass() + lever.x() * lever.x() / inertia.x() +
+                            lever.y() * lever.y() / inertia.y() + lever.z() * lever.z() / inertia.z();
+      double limit = speed / (inverse_mass * dt);
+      force -= direction * (friction_force < limit ? friction_force : limit);
+    };
+    body.AccumulateForce(force, point, false);
+    num_contacts++;
+  };
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <memory>
+#include <vector>
+#include <chrono/physics/ChBody.h>
+#include "origin.hh"
+#include "terrain.hh"
+
+// Analytic contact between cylindrical wheels and the road profile of a terrain replacing Bullet collision detection.
+// For each wheel the deepest point of the rim below the locally linearised road is determined and a spring-damper
+// normal force and a regularised Coulomb friction force are applied there using the force accumulators of the wheel.
+// The wheel axis is the z axis of the wheel body as for ChCollisionShapeCylinder.
+class WheelContact {
+public:
+  WheelContact(const Terrain &terrain, const FloatingOrigin &origin, double stiffness, double damping, double friction);
+
+  void add(std::shared_ptr<chrono::ChBody> wheel, double radius, double length);
+  // Replace the accumulated forces of the wheels with the contact forces for the current state.
+  // The forces are applied over the next step of size dt, which limits the friction impulse.
+  void update(double dt);
+
+  const Terrain &terrain;
+  const FloatingOrigin &origin;
+  double stiffness;
+  double damping;
+  double friction;
+  // Sliding speed below which friction is reduced smoothly to zero
+  double slip_velocity;
+  int num_contacts;
+
+protected:
+  struct Wheel {
+    std::shared_ptr<chrono::ChBody> body;
+    double radius;
+    double length;
+  };
+  std::vector<Wheel> wheels;
+};
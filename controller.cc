@@ -0,0 +1,64 @@
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include "cosim.hh"
+
+// Stand-in external controller for "./gears --cosim".
+// Each vehicle is held at the target speed by driving its wheels with a torque proportional to the speed error.
+// The torque acts in the direction in which the wheel is currently turning.
+
+const double gain = 0.02;
+const double max_torque = 0.01;
+
+int main(int argc, char *argv[])
+{
+  const char *name = argc > 1 ? argv[1] : "/gears";
+  double target = argc > 2 ? atof(argv[2]) : 1.0;
+
+  // Wait for the simulator to create the segment
+  printf("controller: waiting for %s\n", name);
+  CosimChannel *channel = NULL;
+  for (int i=0; i<100; i++) {
+    channel = new CosimChannel(name, false);
+    if (channel->valid())
+      break;
+    delete channel;
+    channel = NULL;
+    usleep(100000);
+  };
+  if (!channel)
+    return 1;
+
+  CosimMessage state;
+  CosimMessage command;
+  long steps = 0;
+  int idle = 0;
+  while (idle < 5) {
+    if (!channel->receive(state, 1000000)) {
+      idle++;
+      continue;
+    };
+    idle = 0;
+    int motors_per_body = state.num_bodies > 0 ? state.num_motors / state.num_bodies : 0;
+    command.sequence = state.sequence;
+    command.time = state.time;
+    command.num_bodies = 0;
+    command.num_motors = state.num_motors;
+    const double *speeds = state.values + 6 * state.num_bodies;
+    for (int i=0; i<state.num_motors; i++) {
+      int body = motors_per_body > 0 ? i / motors_per_body : 0;
+      double velocity = state.values[6 * body + 3];
+      double torque = gain * (target - velocity) * (speeds[i] >= 0.0 ? 1.0 : -1.0);
+      if (torque > max_torque)
+        torque = max_torque;
+      if (torque < -max_torque)
+        torque = -max_torque;
+      command.values[i] = torque;
+    };
+    channel->send(command);
+    steps++;
+  };
+  printf("controller: %ld steps\n", steps);
+  delete channel;
+  return 0;
+}
@@ -0,0 +1,156 @@
+#include <chrono>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <new>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "cosim.hh"
+
+#define COSIM_MAGIC 0x436f5369
+
+// Number of polls of the ring before the consumer goes to sleep
+static const int spin_count = 2000;
+
+static long futex(std::atomic<uint32_t> *address, int operation, uint32_t value, const struct timespec *timeout)
+{
+  return syscall(SYS_futex, reinterpret_cast<uint32_t *>(address), operation, value, timeout, NULL, 0);
+}
+
+CosimChannel::CosimChannel(const char *name, bool simulator):
+  name(name), simulator(simulator), segment(NULL), outgoing(NULL), incoming(NULL), round_trips(0), timeouts(0),
+  total_latency(0.0), max_latency(0.0)
+{
+  int fd = shm_open(name, simulator ? O_CREAT | O_RDWR : O_RDWR, 0600);
+  if (fd < 0) {
+    // A missing segment is expected while the controller waits for the simulator
+    if (simulator || errno != ENOENT)
+      perror(name);
+    return;
+  };
+  if (simulator && ftruncate(fd, sizeof(CosimSegment)) < 0) {
+    perror(name);
+    close(fd);
+    return;
+  };
+  // The simulator may have created the segment without resizing it yet. Reading it would raise SIGBUS.
+  struct stat status;
+  if (!simulator && (fstat(fd, &status) < 0 || status.st_size < (off_t)sizeof(CosimSegment))) {
+    close(fd);
+    return;
+  };
+  void *address = mmap(NULL, sizeof(CosimSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (address == MAP_FAILED) {
+    perror(name);
+    return;
+  };
+  segment = static_cast<CosimSegment *>(address);
+  if (simulator) {
+    new (segment) CosimSegment();
+    std::atomic_thread_fence(std::memory_order_release);
+    segment->magic = COSIM_MAGIC;
+  } else if (segment->magic != COSIM_MAGIC) {
+    // A zero magic number means that the simulator has not initialised the segment yet
+    if (segment->magic != 0)
+      fprintf(stderr, "%s: not a co-simulation segment\n", name);
+    munmap(segment, sizeof(CosimSegment));
+    segment = NULL;
+    return;
+  };
+  outgoing = simulator ? &segment->states : &segment->commands;
+  incoming = simulator ? &segment->commands : &segment->states;
+}
+
+CosimChannel::~CosimChannel()
+{
+  if (!segment)
+    return;
+  munmap(segment, sizeof(CosimSegment));
+  if (simulator)
+    shm_unlink(name.c_str());
+  if (round_trips > 0)
+    printf("%s: %ld round trips, %.1f us on average, %.1f us at most, %ld timeouts\n", name.c_str(), round_trips,
+           total_latency / round_trips, max_latency, timeouts);
+}
+
+bool CosimChannel::send(const CosimMessage &message)
+{
+  uint32_t head = outgoing->head.load(std::memory_order_relaxed);
+  if (head - outgoing->tail.load(std::memory_order_acquire) >= COSIM_CAPACITY)
+    return false;
+  CosimMessage &slot = outgoing->messages[head % COSIM_CAPACITY];
+  int num_values = message.num_bodies * 6 + message.num_motors;
+  slot.sequence = message.sequence;
+  slot.time = message.time;
+  slot.num_bodies = message.num_bodies;
+  slot.num_motors = message.num_motors;
+  memcpy(slot.values, message.values, num_values * sizeof(double));
+  outgoing->head.store(head + 1, std::memory_order_seq_cst);
+  if (outgoing->waiting.load(std::memory_order_seq_cst))
+    futex(&outgoing->head, FUTEX_WAKE, 1, NULL);
+  return true;
+}
+
+bool CosimChannel::receive(CosimMessage &message, int timeout_us)
+{
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(timeout_us);
+  uint32_t tail = incoming->tail.load(std::memory_order_relaxed);
+  int spin = 0;
+  while (incoming->head.load(std::memory_order_acquire) == tail) {
+    if (spin++ < spin_count)
+      continue;
+    // The futex wait can return early (spurious wake-up or EINTR), so sleep again until the deadline has passed
+    auto left = deadline - std::chrono::steady_clock::now();
+    long remaining = std::chrono::duration_cast<std::chrono::nanoseconds>(left).count();
+    if (remaining <= 0)
+      return false;
+    // Announce the sleep and check again so that a message sent in between is not missed
+    incoming->waiting.store(1, std::memory_order_seq_cst);
+    if (incoming->head.load(std::memory_order_seq_cst) == tail) {
+      struct timespec timeout = {remaining / 1000000000L, remaining % 1000000000L};
+      futex(&incoming->head, FUTEX_WAIT, tail, &timeout);
+    };
+    incoming->waiting.store(0, std::memory_order_relaxed);
+  };
+  const CosimMessage &slot = incoming->messages[tail % COSIM_CAPACITY];
+  int num_values = slot.num_bodies * 6 + slot.num_motors;
+  if (num_values < 0 || num_values > COSIM_MAX_VALUES)
+    num_values = 0;
+  message.sequence = slot.sequence;
+  message.time = slot.time;
+  message.num_bodies = slot.num_bodies;
+  message.num_motors = slot.num_motors;
+  memcpy(message.values, slot.values, num_values * sizeof(double));
+  incoming->tail.store(tail + 1, std::memory_order_release);
+  return true;
+}
+
+bool CosimChannel::exchange(const CosimMessage &state, CosimMessage &command, int timeout_us)
+{
+  auto start = std::chrono::steady_clock::now();
+  if (!send(state)) {
+    timeouts++;
+    return false;
+  };
+  while (true) {
+    int elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    if (elapsed >= timeout_us || !receive(command, timeout_us - elapsed)) {
+      timeouts++;
+      return false;
+    };
+    if (command.sequence == state.sequence)
+      break;
+  };
+  double latency = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+  round_trips++;
+  total_latency += latency;
+  if (latency > max_latency)
+    max_latency = latency;
+  return true;
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#define COSIM_CAPACITY 16
+#define COSIM_MAX_VALUES 1024
+
+// Message exchanged with an external controller.
+// States hold "num_bodies" body states (position and velocity, 6 values each) followed by "num_motors" motor speeds.
+// Commands hold "num_motors" motor torques and repeat the sequence number of the state they answer.
+struct CosimMessage {
+  uint64_t sequence;
+  double time;
+  int32_t num_bodies;
+  int32_t num_motors;
+  double values[COSIM_MAX_VALUES];
+};
+
+// Single producer single consumer ring of messages.
+// Head and tail are on separate cache lines. The consumer sets "waiting" before sleeping on the futex of "head",
+// so the producer only makes a system call if the consumer is actually asleep.
+struct CosimRing {
+  alignas(64) std::atomic<uint32_t> head;
+  std::atomic<uint32_t> waiting;
+  alignas(64) std::atomic<uint32_t> tail;
+  alignas(64) CosimMessage messages[COSIM_CAPACITY];
+};
+
+struct CosimSegment {
+  uint32_t magic;
+  CosimRing states;
+  CosimRing commands;
+};
+
+// Co-simulation channel in the POSIX shared memory segment "name" (e.g. "/gears").
+// The simulator creates the segment, sends states and receives commands.
+// The controller opens the existing segment, receives states and sends commands.
+// The segment is unlinked when the simulator's channel is destroyed and the round trip statistics are printed.
+class CosimChannel {
+public:
+  CosimChannel(const char *name, bool simulator);
+  ~CosimChannel();
+
+  bool valid(void) const { return segment != NULL; }
+  // Append a message to the outgoing ring. Returns false if the ring is full.
+  bool send(const CosimMessage &message);
+  // Take the next message from the incoming ring. Spins briefly and then sleeps on a futex.
+  // Returns false if no message arrived within the timeout.
+  bool receive(CosimMessage &message, int timeout_us);
+  // Send a state and wait for the command answering it, skipping late answers to earlier states.
+  // Returns false on timeout.
+  bool exchange(const CosimMessage &state, CosimMessage &command, int timeout_us);
+
+  std::string name;
+  bool simulator;
+  CosimSegment *segment;
+  CosimRing *outgoing;
+  CosimRing *incoming;
+  long round_trips;
+  long timeouts;
+  double total_latency;
+  double max_latency;
+};
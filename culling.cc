@@ -0,0 +1,65 @@
+#include <cmath>
+#include "culling.hh"
+
+#define CULLED -1
+#define DETAIL 0
+#define POINTS 1
+
+Culling::Culling(float aspect, float lod_depth):
+  aspect(aspect), lod_depth(lod_depth), num_detail(0), num_points(0), num_culled(0)
+{
+}
+
+void Culling::update(const std::vector<std::shared_ptr<chrono::ChBody>> &bodies, double radius,
+                     PoseBuffer &detail, PoseBuffer &points, const chrono::ChVector3d &offset)
+{
+  int n = bodies.size();
+  lod.resize(n);
+  slot.resize(n);
+
+  // Classify bodies in parallel
+  #pragma omp parallel for schedule(static)
+  for (int i=0; i<n; i++) {
+    const chrono::ChBody &body = *bodies[i];
+    if (body.IsFixed()) {
+      lod[i] = CULLED;
+      continue;
+    };
+    chrono::ChVector3d position = body.GetPos() + offset;
+    if (fabs(position.x()) - radius > 1.0 ||
+        (fabs(position.y()) - radius) * aspect > 1.0 ||
+        fabs(position.z()) - radius > 1.0)
+      lod[i] = CULLED;
+    else
+      lod[i] = position.z() > lod_depth ? POINTS : DETAIL;
+  };
+
+  // Compact the visible bodies
+  num_detail = 0;
+  num_points = 0;
+  num_culled = 0;
+  for (int i=0; i<n; i++) {
+    if (lod[i] == DETAIL)
+      slot[i] = num_detail < detail.capacity ? num_detail++ : -1;
+    else if (lod[i] == POINTS)
+      slot[i] = num_points < points.capacity ? num_points++ : -1;
+    else {
+      slot[i] = -1;
+      num_culled++;
+    };
+  };
+
+  // Write poses of visible bodies in parallel
+  float *detail_region = detail.begin();
+  float *points_region = points.begin();
+  #pragma omp parallel for schedule(static)
+  for (int i=0; i<n; i++) {
+    if (slot[i] < 0) continue;
+    if (lod[i] == DETAIL)
+      detail.write(detail_region, slot[i], *bodies[i], offset);
+    else
+      points.write(points_region, slot[i], *bodies[i], offset);
+  };
+  points.end(num_points);
+  detail.end(num_detail);
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <memory>
+#include <vector>
+#include <chrono/physics/ChBody.h>
+#include "pose.hh"
+
+// Culling of bodies against the orthographic view volume of the scenes ([-1, 1] in x, y * aspect and z).
+// Each body is tested with a bounding sphere. Visible bodies nearer than lod_depth are written to the
+// full detail instance buffer and the remaining visible bodies to the low detail (point) buffer.
+class Culling {
+public:
+  Culling(float aspect, float lod_depth);
+
+  void update(const std::vector<std::shared_ptr<chrono::ChBody>> &bodies, double radius,
+              PoseBuffer &detail, PoseBuffer &points,
+              const chrono::ChVector3d &offset = chrono::ChVector3d(0, 0, 0));
+
+  float aspect;
+  float lod_depth;
+  int num_detail;
+  int num_points;
+  int num_culled;
+
+protected:
+  std::vector<signed char> lod;
+  std::vector<int> slot;
+};
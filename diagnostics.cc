@@ -0,0 +1,169 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono/collision/bullet/ChCollisionSystemBullet.h>
+#include <chrono/collision/bullet/cbtBulletCollisionCommon.h>
+#include "diagnostics.hh"
+
+// Halving stops below this margin or envelope
+static const float min_margin = 1e-4f;
+
+ContactStatistics contactStatistics(chrono::ChSystem &sys)
+{
+  ContactStatistics result = {0, 0, 0, (int)sys.GetNumContacts(), (int)sys.GetNumConstraints()};
+  auto bullet = std::dynamic_pointer_cast<chrono::ChCollisionSystemBullet>(sys.GetCollisionSystem());
+  if (bullet) {
+    cbtCollisionWorld *world = bullet->GetBulletCollisionWorld();
+    result.pairs = world->getBroadphase()->getOverlappingPairCache()->getNumOverlappingPairs();
+    cbtDispatcher *dispatcher = world->getDispatcher();
+    for (int i=0; i<dispatcher->getNumManifolds(); i++) {
+      int points = dispatcher->getManifoldByIndexInternal(i)->getNumContacts();
+      if (points > 0) {
+        result.manifolds++;
+        result.points += points;
+      };
+    };
+  };
+  return result;
+}
+
+ContactLog::ContactLog(int argc, char *argv[]):
+  enabled(false), steps(0), total{0, 0, 0, 0, 0}
+{
+  for (int i=1; i<argc; i++)
+    if (!strcmp(argv[i], "--contacts")) {
+      enabled = true;
+      printf("time pairs manifolds points contacts constraints\n");
+    };
+}
+
+ContactLog::~ContactLog()
+{
+  if (enabled && steps > 0)
+    printf("contacts: %ld steps, on average %.1f pairs, %.1f manifolds, %.1f points, %.1f contacts, %.1f constraints\n",
+           steps, (double)total.pairs / steps, (double)total.manifolds / steps, (double)total.points / steps,
+           (double)total.contacts / steps, (double)total.constraints / steps);
+}
+
+void ContactLog::update(chrono::ChSystem &sys)
+{
+  if (!enabled)
+    return;
+  ContactStatistics statistics = contactStatistics(sys);
+  steps++;
+  total.pairs += statistics.pairs;
+  total.manifolds += statistics.manifolds;
+  total.points += statistics.points;
+  total.contacts += statistics.contacts;
+  total.constraints += statistics.constraints;
+  printf("%g %d %d %d %d %d\n", sys.GetChTime(), statistics.pairs, statistics.manifolds, statistics.points,
+         statistics.contacts, statistics.constraints);
+}
+
+bool loadMargins(const char *name, std::vector<ShapeMargins> &margins)
+{
+  std::string filename = std::string(name) + ".margins";
+  FILE *file = fopen(filename.c_str(), "r");
+  if (!file)
+    return false;
+  char shape[64];
+  float margin;
+  float envelope;
+  while (fscanf(file, "%63s %f %f", shape, &margin, &envelope) == 3)
+    for (auto entry=margins.begin(); entry!=margins.end(); entry++)
+      if (entry->name == shape) {
+        entry->margin = margin;
+        entry->envelope = envelope;
+      };
+  fclose(file);
+  return true;
+}
+
+bool saveMargins(const char *name, const std::vector<ShapeMargins> &margins)
+{
+  std::string filename = std::string(name) + ".margins";
+  FILE *file = fopen(filename.c_str(), "w");
+  if (!file) {
+    perror(filename.c_str());
+    return false;
+  };
+  for (auto entry=margins.begin(); entry!=margins.end(); entry++)
+    fprintf(file, "%s %g %g\n", entry->name.c_str(), entry->margin, entry->envelope);
+  fclose(file);
+  return true;
+}
+
+struct MarginTrial {
+  double step_time;
+  double max_speed;
+  double points;
+  std::vector<chrono::ChVector3d> positions;
+};
+
+// Simulate the scene and record the time per step in milliseconds, the average number of narrowphase contact points,
+// and the final world positions and largest final speed of the moving bodies. Returns false if the simulation failed.
+static bool marginTrial(MarginSceneFactory create, const std::vector<ShapeMargins> &margins, double dt, int steps,
+                        MarginTrial &result)
+{
+  long points = 0;
+  result.max_speed = 0.0;
+  auto observe = [&](chrono::ChSystem &sys) {
+    points += contactStatistics(sys).points;
+    // Keep the largest speed after the latest step
+    result.max_speed = 0.0;
+    for (auto body=sys.GetBodies().begin(); body!=sys.GetBodies().end(); body++)
+      if (!(*body)->IsFixed() && (*body)->GetPosDt().Length() > result.max_speed)
+        result.max_speed = (*body)->GetPosDt().Length();
+  };
+  result.step_time = trial([&]() { return create(margins); }, dt, steps, result.positions, observe);
+  result.points = (double)points / steps;
+  return result.step_time >= 0.0;
+}
+
+int tuneMargins(const char *name, MarginSceneFactory create, std::vector<ShapeMargins> margins,
+                double dt, int steps, double tolerance)
+{
+  MarginTrial reference;
+  if (!marginTrial(create, margins, dt, steps, reference)) {
+    fprintf(stderr, "%s: reference run failed\n", name);
+    return 1;
+  };
+  printf("%-12s %-9s %10s %8s %8s %9s %9s\n", "shape", "parameter", "value", "points", "ms/step", "error", "max speed");
+  printf("%-12s %-9s %10s %8.1f %8.3f %9.2e %9.3f\n", "initial", "", "", reference.points, reference.step_time,
+         0.0, reference.max_speed);
+  for (unsigned int i=0; i<margins.size(); i++)
+    for (int parameter=0; parameter<2; parameter++)
+      while (true) {
+        std::vector<ShapeMargins> candidate = margins;
+        float &value = parameter == 0 ? candidate[i].margin : candidate[i].envelope;
+        value *= 0.5f;
+        if (value < min_margin)
+          break;
+        MarginTrial result;
+        bool success = marginTrial(create, candidate, dt, steps, result);
+        double error = success ? rmsError(result.positions, reference.positions) : INFINITY;
+        bool stable = error < tolerance && result.max_speed <= 2.0 * reference.max_speed + 0.05;
+        printf("%-12s %-9s %10.2e %8.1f %8.3f %9.2e %9.3f%s\n", candidate[i].name.c_str(),
+               parameter == 0 ? "margin" : "envelope", value, result.points, success ? result.step_time : -1.0,
+               error, result.max_speed, stable ? "" : " unstable");
+        fflush(stdout);
+        if (!stable)
+          break;
+        margins = candidate;
+      };
+  if (!saveMargins(name, margins))
+    return 1;
+  for (auto entry=margins.begin(); entry!=margins.end(); entry++)
+    printf("%s.margins: %s margin %g envelope %g\n", name, entry->name.c_str(), entry->margin, entry->envelope);
+  return 0;
+}
+
+bool tuneMarginsOption(int argc, char *argv[], const char *name, MarginSceneFactory create,
+                       const std::vector<ShapeMargins> &margins, double dt, int steps)
+{
+  if (argc < 2 || strcmp(argv[1], "--tune-margins"))
+    return false;
+  tuneMargins(name, create, margins, dt, steps, argc > 2 ? atof(argv[2]) : 0.01);
+  return true;
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <functional>
+#include <string>
+#include <vector>
+#include <chrono/physics/ChSystem.h>
+#include "scaling.hh"
+
+// Contact counts of the last step
+struct ContactStatistics {
+  int pairs;        // overlapping bounding boxes found by the broadphase
+  int manifolds;    // body pairs with contact points in the narrowphase
+  int points;       // narrowphase contact points
+  int contacts;     // contacts added to the contact container
+  int constraints;  // bilateral and unilateral constraints passed to the solver
+};
+
+// Read the contact counts from the Bullet collision world and the system.
+// Broadphase and narrowphase counts are zero for other collision systems.
+ContactStatistics contactStatistics(chrono::ChSystem &sys);
+
+// Per step contact statistics.
+// With "--contacts" on the command line a line "time pairs manifolds points contacts constraints" is printed per step.
+// The averages are printed when the log is destroyed.
+class ContactLog {
+public:
+  ContactLog(int argc, char *argv[]);
+  ~ContactLog();
+
+  // Record the contact statistics of the last step
+  void update(chrono::ChSystem &sys);
+
+  bool enabled;
+  long steps;
+  ContactStatistics total;
+};
+
+// Safe margin and envelope of one kind of collision shape
+struct ShapeMargins {
+  std::string name;
+  float margin;
+  float envelope;
+};
+
+typedef std::function<Scene(const std::vector<ShapeMargins> &margins)> MarginSceneFactory;
+
+// Read and write the margins "<name>.margins" in the working directory.
+// Loading only overwrites the entries of shapes listed in the file.
+bool loadMargins(const char *name, std::vector<ShapeMargins> &margins);
+bool saveMargins(const char *name, const std::vector<ShapeMargins> &margins);
+
+// Halve the safe margin and then the envelope of each shape in turn as long as the scene stays stable.
+// A trial is stable if the final positions of the moving bodies are within the tolerance (RMS) of a run
+// with the initial margins and the bodies do not move much faster than in that run (jitter).
+// The result is written to the margins file of the scene.
+int tuneMargins(const char *name, MarginSceneFactory create, std::vector<ShapeMargins> margins,
+                double dt, int steps, double tolerance);
+
+// Run the margin tuner if the first command line argument is "--tune-margins" (optionally followed by the tolerance)
+// and return true in that case.
+bool tuneMarginsOption(int argc, char *argv[], const char *name, MarginSceneFactory create,
+                       const std::vector<ShapeMargins> &margins, double dt, int steps);
@@ -1,17 +1,49 @@
+#include <algorithm>
 #include <cmath>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #include <chrono/core/ChQuaternion.h>
+#include <chrono/core/ChTimer.h>
 #include <chrono/physics/ChBody.h>
 #include <chrono/physics/ChLinkMotorRotationTorque.h>
 #include <chrono/physics/ChSystemNSC.h>
+#include <chrono/physics/ChSystemSMC.h>
+#include "renderer.hh"
+#include "wheels.hh"
+#include "origin.hh"
+#include "terrain.hh"
+#include "contact.hh"
+#include "brake.hh"
+#include "motorbank.hh"
+#include "cosim.hh"
+#include "telemetry.hh"
+#include "scaling.hh"
+#include "autotune.hh"
+#include "governor.hh"
+#include "diagnostics.hh"
+#include "backend.hh"
 
 int width = 1280;
 int height = 720;
 
-const char *vertex_cuboid = "#version 410 core\n\
-uniform float aspect;\n\
+// Vehicle dimensions
+const float a = 0.3;
+const float b = 0.04;
+const float c = 0.2;
+const float radius = 0.03;
+const float length = 0.02;
+const float margin = 0.01f;
+const float envelope = 0.001f;
+
+// Distance between vehicles of a fleet
+const double spacing = 0.5;
+
+const char *vertex_cuboid = "#version 410 core\n" GLOBALS_BLOCK "\
 uniform vec3 axes;\n\
 uniform vec3 translation;\n\
 uniform mat3 rotation;\n\
@@ -21,11 +53,10 @@ out vec3 n;\n\
 void main()\n\
 {\n\
   n = rotation * normal;\n\
-  gl_Position = vec4((rotation * (point * axes) + translation) * vec3(1, aspect, 1), 1);\n\
+  gl_Position = vec4((rotation * (point * axes) + translation) * vec3(1, aspect, depth), 1);\n\
 }";
 
-const char *fragment_cuboid = "#version 410 core\n\
-uniform vec3 light;\n\
+const char *fragment_cuboid = "#version 410 core\n" GLOBALS_BLOCK "\
 in vec3 n;\n\
 out vec3 fragColor;\n\
 void main()\n\
@@ -35,33 +66,6 @@ void main()\n\
   fragColor = vec3(1, 1, 1) * (ambient + diffuse);\n\
 }";
 
-const char *vertex_wheel = "#version 410 core\n\
-uniform float aspect;\n\
-uniform float radius;\n\
-uniform int num_points;\n\
-uniform vec3 translation;\n\
-uniform mat3 rotation;\n\
-in vec3 point;\n\
-out vec3 color;\n\
-void main()\n\
-{\n\
-  vec3 radius_vector = radius * vec3(cos(2.0 * 3.1415926 * gl_InstanceID / num_points), sin(2.0 * 3.1415926 * gl_InstanceID / num_points), 0);\n\
-  if (gl_InstanceID == 0)\n\
-    color = vec3(1, 0, 0);\n\
-  else\n\
-    color = vec3(1, 1, 1);\n\
-  gl_Position = vec4((rotation * (point + radius_vector) + translation) * vec3(1, aspect, 1), 1);\n\
-}";
-
-const char *fragment_wheel = "#version 410 core\n\
-in vec3 color;\n\
-out vec3 fragColor;\n\
-void main()\n\
-{\n\
-  fragColor = color;\n\
-  fragColor = vec3(1, 1, 1);\n\
-}";
-
 // Vertex array data
 GLfloat vertices_cuboid[] = {
   // Front face
@@ -101,14 +105,6 @@ GLfloat vertices_cuboid[] = {
   -0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f
 };
 
-GLfloat vertices_wheel[] = {
-   0.0f,  0.0f,  0.0f
-};
-
-unsigned int indices_wheel[] = {
-   0
-};
-
 unsigned int indices_cuboid[] = {
    0,  1,  2,  3,
    4,  5,  6,  7,
@@ -118,195 +114,39 @@ unsigned int indices_cuboid[] = {
   20, 21, 22, 23
 };
 
-void handleCompileError(const char *step, GLuint shader)
-{
-  GLint result = GL_FALSE;
-  glGetShaderiv(shader, GL_COMPILE_STATUS, &result);
-  if (result == GL_FALSE) {
-    char buffer[1024];
-    glGetShaderInfoLog(shader, 1024, NULL, buffer);
-    if (buffer[0])
-      fprintf(stderr, "%s: %s\n", step, buffer);
-  };
-}
-
-void handleLinkError(const char *step, GLuint program)
-{
-  GLint result = GL_FALSE;
-  glGetProgramiv(program, GL_LINK_STATUS, &result);
-  if (result == GL_FALSE) {
-    char buffer[1024];
-    glGetProgramInfoLog(program, 1024, NULL, buffer);
-    if (buffer[0])
-      fprintf(stderr, "%s: %s\n", step, buffer);
-  };
-}
-
-class BrakeFunction: public chrono::ChFunction {
-public:
-  double braking;
-  std::shared_ptr<chrono::ChLinkMotorRotationTorque> motor;
-
-  virtual BrakeFunction* Clone() const override { return new BrakeFunction(*this); }
-
-  virtual double GetVal(double x) const override {
-    double w = motor->GetMotorAngleDt();
-    if (w > 0.005)
-      return -braking;
-    else if (w < -0.005)
-      return braking;
-    else
-      return 0.0;
-  }
+struct Vehicle {
+  std::shared_ptr<chrono::ChBody> body;
+  std::vector<std::shared_ptr<chrono::ChBody>> wheels;
+  std::vector<std::shared_ptr<chrono::ChLinkMotorRotationTorque>> motors;
+  std::vector<double> braking;
 };
 
-int main(void)
+void setupSystem(chrono::ChSystem &sys, int n)
 {
-  glfwInit();
-  GLFWwindow *window = glfwCreateWindow(width, height, "Vehicle with gears with Project Chrono", NULL, NULL);
-  glfwMakeContextCurrent(window);
-  glewInit();
-
-  glClearColor(0.1f, 0.1f, 0.1f, 0.0f);
-  glViewport(0, 0, width, height);
-
-  // Cuboid shaders
-  GLuint vertex_shader_cuboid = glCreateShader(GL_VERTEX_SHADER);
-  glShaderSource(vertex_shader_cuboid, 1, &vertex_cuboid, NULL);
-  glCompileShader(vertex_shader_cuboid);
-  handleCompileError("Vertex shader", vertex_shader_cuboid);
-
-  GLuint fragment_shader_cuboid = glCreateShader(GL_FRAGMENT_SHADER);
-  glShaderSource(fragment_shader_cuboid, 1, &fragment_cuboid, NULL);
-  glCompileShader(fragment_shader_cuboid);
-  handleCompileError("Fragment shader", fragment_shader_cuboid);
-
-  GLuint program_cuboid = glCreateProgram();
-  glAttachShader(program_cuboid, vertex_shader_cuboid);
-  glAttachShader(program_cuboid, fragment_shader_cuboid);
-  glLinkProgram(program_cuboid);
-  handleLinkError("Shader program", program_cuboid);
-
-  // Wheel shaders
-  GLuint vertex_shader_wheel = glCreateShader(GL_VERTEX_SHADER);
-  glShaderSource(vertex_shader_wheel, 1, &vertex_wheel, NULL);
-  glCompileShader(vertex_shader_wheel);
-  handleCompileError("Vertex shader", vertex_shader_wheel);
-
-  GLuint fragment_shader_wheel = glCreateShader(GL_FRAGMENT_SHADER);
-  glShaderSource(fragment_shader_wheel, 1, &fragment_wheel, NULL);
-  glCompileShader(fragment_shader_wheel);
-  handleCompileError("Fragment shader", fragment_shader_wheel);
-
-  GLuint program_wheel = glCreateProgram();
-  glAttachShader(program_wheel, vertex_shader_wheel);
-  glAttachShader(program_wheel, fragment_shader_wheel);
-  glLinkProgram(program_wheel);
-  handleLinkError("Shader program", program_wheel);
-
-  GLuint vao_cuboid;
-  GLuint vbo_cuboid;
-  GLuint idx_cuboid;
-
-  glGenVertexArrays(1, &vao_cuboid);
-  glBindVertexArray(vao_cuboid);
-
-  glGenBuffers(1, &vbo_cuboid);
-  glBindBuffer(GL_ARRAY_BUFFER, vbo_cuboid);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(vertices_cuboid), vertices_cuboid, GL_STATIC_DRAW);
-  glGenBuffers(1, &idx_cuboid);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, idx_cuboid);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices_cuboid), indices_cuboid, GL_STATIC_DRAW);
-
-  glUseProgram(program_cuboid);
-
-  glVertexAttribPointer(glGetAttribLocation(program_cuboid, "point"),
-                        3, GL_FLOAT, GL_FALSE,
-                        6 * sizeof(float), (void *)0);
-  glVertexAttribPointer(glGetAttribLocation(program_cuboid, "normal"),
-                        3, GL_FLOAT, GL_FALSE,
-                        6 * sizeof(float), (void *)(3 * sizeof(float)));
-
-  glEnableVertexAttribArray(0);
-  glEnableVertexAttribArray(1);
-
-  float light[3] = {0.36f, 0.8f, -0.48f};
-  glUniform3fv(glGetUniformLocation(program_cuboid, "light"), 1, light);
-  glUniform1f(glGetUniformLocation(program_cuboid, "aspect"), (float)width / (float)height);
-  float a = 0.3;
-  float b = 0.04;
-  float c = 0.2;
-  float axes[3] = {a, b, c};
-  glUniform3fv(glGetUniformLocation(program_cuboid, "axes"), 1, axes);
-
-  GLuint vao_wheel;
-  GLuint vbo_wheel;
-  GLuint idx_wheel;
-
-  glGenVertexArrays(1, &vao_wheel);
-  glBindVertexArray(vao_wheel);
-
-  glGenBuffers(1, &vbo_wheel);
-  glBindBuffer(GL_ARRAY_BUFFER, vbo_wheel);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(vertices_wheel), vertices_wheel, GL_STATIC_DRAW);
-  glGenBuffers(1, &idx_wheel);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, idx_wheel);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices_wheel), indices_wheel, GL_STATIC_DRAW);
-
-  glUseProgram(program_wheel);
-
-  glVertexAttribPointer(glGetAttribLocation(program_wheel, "point"),
-                        3, GL_FLOAT, GL_FALSE,
-                        3 * sizeof(float), (void *)0);
-
-  glEnableVertexAttribArray(0);
-
-  float radius = 0.03;
-  float length = 0.02;
-  int num_points = 18;
-  glUniform1f(glGetUniformLocation(program_wheel, "aspect"), (float)width / (float)height);
-  glUniform1f(glGetUniformLocation(program_wheel, "radius"), radius);
-  glUniform1i(glGetUniformLocation(program_wheel, "num_points"), num_points);
-
-  glDisable(GL_CULL_FACE);
-  glEnable(GL_DEPTH_TEST);
-  glPointSize(2.0f);
-
-  float margin = 0.01f;
-  float envelope = 0.001f;
-  float max_dt = 0.02;
-  int n = 1;
-
-  chrono::ChSystemNSC sys;
-  sys.SetTimestepperType(chrono::ChTimestepper::Type::RUNGEKUTTA45);
   sys.SetGravitationalAcceleration(chrono::ChVector3(0.0, -0.25, 0.0));
   sys.SetCollisionSystemType(chrono::ChCollisionSystem::Type::BULLET);
   sys.SetTimestepperType(chrono::ChTimestepper::Type::EULER_IMPLICIT_LINEARIZED);
   sys.SetSolverType(chrono::ChSolver::Type::BARZILAIBORWEIN);
   sys.GetSolver()->AsIterative()->SetMaxIterations(25 / n);
+}
 
-  auto material = chrono_types::make_shared<chrono::ChContactMaterialNSC>();
+std::shared_ptr<chrono::ChContactMaterial> createMaterial(chrono::ChContactMethod method)
+{
+  auto material = createContactMaterial(method);
   material->SetStaticFriction(0.8f);
   material->SetSlidingFriction(0.3f);
   material->SetRestitution(0.3f);
+  return material;
+}
 
-  auto ground = chrono_types::make_shared<chrono::ChBody>();
-  ground->SetFixed(true);
-  ground->SetMass(1e+6);
-  ground->SetInertiaXX(chrono::ChVector3(1e+5, 1e+5, 1e+5));
-  ground->SetPos(chrono::ChVector3(0.0, -0.3, 0.0));
-  sys.AddBody(ground);
-
-  auto coll_model_ground = chrono_types::make_shared<chrono::ChCollisionModel>();
-  coll_model_ground->SetSafeMargin(margin);
-  coll_model_ground->SetEnvelope(envelope);
-  auto shape_ground = chrono_types::make_shared<chrono::ChCollisionShapeBox>(material, 2000.0, 0.2, 2000.0);
-  coll_model_ground->AddShape(shape_ground);
-  coll_model_ground->SetFamily(1);
-  ground->AddCollisionModel(coll_model_ground);
-  ground->EnableCollision(true);
-
-  double speed = 1.0;
+// Vehicle with cuboid body and three wheels. Each wheel is attached to a gear with a torque motor and
+// the gear to the body with a prismatic joint and a spring-damper.
+// Wheels are in collision family 2 and do not collide with each other, so vehicles only touch the ground.
+// The rear wheels are braked using the regularised or the switching brake law.
+Vehicle addVehicle(chrono::ChSystem &sys, std::shared_ptr<chrono::ChContactMaterial> material,
+                   const chrono::ChVector3d &position, double speed, bool collision, bool smooth_brake)
+{
+  Vehicle vehicle;
 
   // https://math.stackexchange.com/questions/4501028/calculating-moment-of-inertia-for-a-cuboid
   auto body = chrono_types::make_shared<chrono::ChBody>();
@@ -316,12 +156,11 @@ int main(void)
   body->SetInertiaXX(chrono::ChVector3(mass * (b * b + c * c) / 12.0,
                                        mass * (a * a + c * c) / 12.0,
                                        mass * (a * a + b * b) / 12.0));
-  body->SetPos(chrono::ChVector3(0.0, 0.0, 0.0));
+  body->SetPos(position);
   body->SetPosDt(chrono::ChVector3(speed, 0.0, 0.0));
   body->SetAngVelLocal(chrono::ChVector3(0.0, 0.0, 0.15));
   sys.AddBody(body);
-
-  std::vector<std::shared_ptr<chrono::ChBody>> wheels;
+  vehicle.body = body;
 
   float mass_wheel = 0.2;
   float mass_gear = 0.2;
@@ -336,7 +175,7 @@ int main(void)
     gear->SetInertiaXX(chrono::ChVector3d(1.0 / 12.0 * mass * radius * radius,
                                           1.0 / 12.0 * mass * radius * radius,
                                           1.0 / 12.0 * mass * radius * radius));
-    gear->SetPos(chrono::ChVector3d(x * a - 0.5 * a, - b - radius, z * c * 0.5));
+    gear->SetPos(position + chrono::ChVector3d(x * a - 0.5 * a, - b - radius, z * c * 0.5));
     gear->SetPosDt(chrono::ChVector3(speed, 0.0, 0.0));
     gear->SetAngVelLocal(chrono::ChVector3(0.0, 0.0, 0.0));
     sys.AddBody(gear);
@@ -348,11 +187,11 @@ int main(void)
     wheel->SetInertiaXX(chrono::ChVector3d(0.25 * mass * radius * radius + 1.0 / 12.0 * mass * length * length,
                                            0.25 * mass * radius * radius + 1.0 / 12.0 * mass * length * length,
                                            0.5 * mass * radius * radius));
-    wheel->SetPos(chrono::ChVector3d(x * a * (0.5 + 0.3) - 0.3 * a, - b - radius, z * c * 0.5));
+    wheel->SetPos(position + chrono::ChVector3d(x * a * (0.5 + 0.3) - 0.3 * a, - b - radius, z * c * 0.5));
     wheel->SetPosDt(chrono::ChVector3(speed, 0.0, 0.0));
     wheel->SetAngVelLocal(chrono::ChVector3(0.0, 0.0, 0.0));
     sys.AddBody(wheel);
-    wheels.push_back(wheel);
+    vehicle.wheels.push_back(wheel);
 
     auto coll_model_wheel = chrono_types::make_shared<chrono::ChCollisionModel>();
     coll_model_wheel->SetSafeMargin(margin);
@@ -362,7 +201,7 @@ int main(void)
     coll_model_wheel->SetFamily(2);
     coll_model_wheel->DisallowCollisionsWith(2);
     wheel->AddCollisionModel(coll_model_wheel);
-    wheel->EnableCollision(true);
+    wheel->EnableCollision(collision);
 
     auto prismatic = chrono_types::make_shared<chrono::ChLinkLockPrismatic>();
     prismatic->Initialize(body, gear, chrono::ChFrame<>(gear->GetPos(), chrono::QuatFromAngleX(-chrono::CH_PI_2)));
@@ -376,81 +215,432 @@ int main(void)
 
     auto revolute = chrono_types::make_shared<chrono::ChLinkMotorRotationTorque>();
     revolute->Initialize(gear, wheel, chrono::ChFrame<>(wheel->GetPos(), chrono::QUNIT));
-    auto brake = chrono_types::make_shared<BrakeFunction>();
-    brake->motor = revolute;
-    brake->braking = x == 1 ? 0.0 : 0.007;
+    double braking = x == 1 ? 0.0 : 0.007;
+    auto brake = chrono_types::make_shared<BrakeFunction>(revolute, braking, smooth_brake);
     revolute->SetTorqueFunction(brake);
     sys.AddLink(revolute);
+    vehicle.motors.push_back(revolute);
+    vehicle.braking.push_back(braking);
   }
+  return vehicle;
+}
 
-  double t = glfwGetTime();
-  while (!glfwWindowShouldClose(window)) {
-    double dt = glfwGetTime() - t;
-    if (dt > max_dt) dt = max_dt;
+// Fleet of vehicles driving side by side on a common road
+std::vector<Vehicle> addFleet(chrono::ChSystem &sys, std::shared_ptr<chrono::ChContactMaterial> material,
+                              int num_vehicles, double speed, bool collision, bool smooth_brake)
+{
+  std::vector<Vehicle> fleet;
+  for (int i=0; i<num_vehicles; i++)
+    fleet.push_back(addVehicle(sys, material, chrono::ChVector3d(0.0, 0.0, (i - 0.5 * (num_vehicles - 1)) * spacing), speed, collision, smooth_brake));
+  return fleet;
+}
+
+// Analytic contact of all wheels of the fleet with the road
+WheelContact *createWheelContact(const Terrain &terrain, const FloatingOrigin &origin, const std::vector<Vehicle> &fleet)
+{
+  WheelContact *contact = new WheelContact(terrain, origin, 300.0, 4.0, 0.3);
+  for (auto vehicle=fleet.begin(); vehicle!=fleet.end(); vehicle++)
+    for (auto wheel=vehicle->wheels.begin(); wheel!=vehicle->wheels.end(); wheel++)
+      contact->add(*wheel, radius, length);
+  return contact;
+}
+
+// Batched brake controller for all motors of the fleet replacing the brake functions of the motors
+MotorBank *createMotorBank(const std::vector<Vehicle> &fleet)
+{
+  MotorBank *bank = new MotorBank(brakeLaw);
+  for (auto vehicle=fleet.begin(); vehicle!=fleet.end(); vehicle++)
+    for (unsigned int i=0; i<vehicle->motors.size(); i++)
+      bank->add(vehicle->motors[i], vehicle->braking[i]);
+  return bank;
+}
 
-    glUseProgram(program_cuboid);
-    glBindVertexArray(vao_cuboid);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo_cuboid);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, idx_cuboid);
-
-    chrono::ChQuaternion quat = body->GetRot();
-    chrono::ChMatrix33 mat(quat);
-    chrono::ChVector3 x = mat.GetAxisX();
-    chrono::ChVector3 y = mat.GetAxisY();
-    chrono::ChVector3 z = mat.GetAxisZ();
-
-    float rotation[9] = {
-      (float)x.x(), (float)y.x(), (float)z.x(),
-      (float)x.y(), (float)y.y(), (float)z.y(),
-      (float)x.z(), (float)y.z(), (float)z.z()
+// Batched controller exchanging the world positions and velocities of the vehicle bodies and the motor speeds
+// with an external controller each step. If the controller does not answer within 100 ms the previous torques are kept.
+MotorBank *createCosimBank(CosimChannel &channel, chrono::ChSystem &sys, const FloatingOrigin &origin,
+                           const std::vector<Vehicle> &fleet)
+{
+  auto state = std::make_shared<CosimMessage>();
+  auto command = std::make_shared<CosimMessage>();
+  state->sequence = 0;
+  MotorBank *bank = new MotorBank([&channel, &sys, &origin, &fleet, state, command]
+                                  (int n, const double *speeds, const double *, double *torques) {
+    int num_bodies = fleet.size();
+    state->sequence++;
+    state->time = sys.GetChTime();
+    state->num_bodies = num_bodies;
+    state->num_motors = n;
+    for (int i=0; i<num_bodies; i++) {
+      chrono::ChVector3d position = fleet[i].body->GetPos() + origin.origin;
+      chrono::ChVector3d velocity = fleet[i].body->GetPosDt();
+      double *values = state->values + 6 * i;
+      for (int j=0; j<3; j++) {
+        values[j] = position[j];
+        values[3 + j] = velocity[j];
+      };
     };
+    memcpy(state->values + 6 * num_bodies, speeds, n * sizeof(double));
+    if (channel.exchange(*state, *command, 100000) && command->num_motors == n)
+      memcpy(torques, command->values, n * sizeof(double));
+  });
+  for (auto vehicle=fleet.begin(); vehicle!=fleet.end(); vehicle++)
+    for (unsigned int i=0; i<vehicle->motors.size(); i++)
+      bank->add(vehicle->motors[i], vehicle->braking[i]);
+  return bank;
+}
+
+// Headless fleet with at least one vehicle
+Scene createFleetScene(chrono::ChContactMethod method, chrono::ChCollisionSystem::Type collision, int num_vehicles)
+{
+  if (num_vehicles < 1)
+    num_vehicles = 1;
+  auto sys = createContactSystem(method);
+  setupSystem(*sys, 1);
+  sys->SetCollisionSystemType(collision);
+  auto material = createMaterial(method);
+  auto origin = std::make_shared<FloatingOrigin>(1.0, 2.0);
+  auto terrain = std::make_shared<Terrain>(*sys, material, -0.2, 1.0, num_vehicles * spacing + 1.5, 2, 4);
+  terrain->margin = margin;
+  terrain->envelope = envelope;
+  terrain->family = 1;
+  std::vector<Vehicle> fleet = addFleet(*sys, material, num_vehicles, 1.0, true, true);
+  auto body = fleet[0].body;
+  std::shared_ptr<MotorBank> bank(createMotorBank(fleet));
+  Scene scene;
+  scene.sys = sys;
+  scene.update = [sys, body, origin, terrain, bank]() {
+    origin->update(*sys, *body);
+    terrain->update(*origin, body->GetPos().x());
+    bank->update();
+  };
+  scene.origin = [origin]() { return origin->origin; };
+  return scene;
+}
+
+Scene createBackendScene(chrono::ChContactMethod method)
+{
+  return createFleetScene(method, chrono::ChCollisionSystem::Type::BULLET, 4);
+}
 
-    glUniformMatrix3fv(glGetUniformLocation(program_cuboid, "rotation"), 1, GL_TRUE, rotation);
+Scene createCollisionScene(chrono::ChCollisionSystem::Type collision, int num_vehicles)
+{
+  return createFleetScene(chrono::ChContactMethod::NSC, collision, num_vehicles);
+}
 
-    chrono::ChVector3 position = body->GetPos();
-    double px = position.x();
-    while (px >= 1.0)
-      px -= 2.0;
-    double dx = px - position.x();
-    float translation[3] = {(float)(position.x() + dx), (float)position.y(), (float)position.z()};
-    glUniform3fv(glGetUniformLocation(program_cuboid, "translation"), 1, translation);
+Scene createScene(void)
+{
+  return createBackendScene(chrono::ChContactMethod::NSC);
+}
 
-    glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
-    glDrawElements(GL_QUADS, 24, GL_UNSIGNED_INT, (void *)0);
-
-    glUseProgram(program_wheel);
-    glBindVertexArray(vao_wheel);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo_wheel);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, idx_wheel);
-
-    for (int i=0; i<3; i++) {
-      auto wheel = wheels[i];
-      chrono::ChQuaternion quat = wheel->GetRot();
-      chrono::ChMatrix33 mat(quat);
-      chrono::ChVector3 x = mat.GetAxisX();
-      chrono::ChVector3 y = mat.GetAxisY();
-      chrono::ChVector3 z = mat.GetAxisZ();
-
-      float rotation[9] = {
-        (float)x.x(), (float)y.x(), (float)z.x(),
-        (float)x.y(), (float)y.y(), (float)z.y(),
-        (float)x.z(), (float)y.z(), (float)z.z()
+// Measure the step time of fleets of increasing size with increasing numbers of threads
+// using Bullet collision detection and the analytic wheel contact
+int benchmark(int max_vehicles)
+{
+  int max_threads = std::thread::hardware_concurrency();
+  double dt = 0.01;
+  int warmup = 50;
+  int steps = 200;
+  printf("contact  vehicles threads ms/step ms/step/vehicle speedup\n");
+  for (int analytic=0; analytic<2; analytic++) {
+    for (int num_vehicles=1; num_vehicles<=max_vehicles; num_vehicles*=2) {
+      double reference = 0.0;
+      for (int threads=1; threads<=max_threads; threads*=2) {
+        chrono::ChSystemNSC sys;
+        setupSystem(sys, 1);
+        sys.SetNumThreads(threads, threads, threads);
+        auto material = createMaterial(chrono::ChContactMethod::NSC);
+        FloatingOrigin origin(1.0, 2.0);
+        Terrain terrain(sys, material, -0.2, 1.0, num_vehicles * spacing + 1.5, 2, 4);
+        terrain.margin = margin;
+        terrain.envelope = envelope;
+        terrain.family = 1;
+        terrain.update(origin, 0.0);
+        std::vector<Vehicle> fleet = addFleet(sys, material, num_vehicles, 1.0, !analytic, true);
+        WheelContact *contact = analytic ? createWheelContact(terrain, origin, fleet) : NULL;
+
+        chrono::ChTimer timer;
+        for (int i=0; i<warmup+steps; i++) {
+          if (i == warmup)
+            timer.start();
+          origin.update(sys, *fleet[0].body);
+          terrain.update(origin, fleet[0].body->GetPos().x());
+          if (contact)
+            contact->update(dt);
+          sys.DoStepDynamics(dt);
+        };
+        timer.stop();
+        delete contact;
+        double step_time = 1000.0 * timer.GetTimeSeconds() / steps;
+        if (threads == 1)
+          reference = step_time;
+        printf("%-8s %8d %7d %7.3f %15.4f %7.2f\n", analytic ? "analytic" : "bullet", num_vehicles, threads, step_time,
+               step_time / num_vehicles, reference / step_time);
       };
+    };
+  };
+  return 0;
+}
 
-      glUniformMatrix3fv(glGetUniformLocation(program_wheel, "rotation"), 1, GL_TRUE, rotation);
-
-      chrono::ChVector3 position = wheel->GetPos();
-      float translation[3] = {(float)(position.x() + dx), (float)position.y(), (float)position.z()};
-      glUniform3fv(glGetUniformLocation(program_wheel, "translation"), 1, translation);
+// Measure the step time of fleets of increasing size with a brake function per motor and with one batched motor bank
+int motors(int max_vehicles)
+{
+  double dt = 0.01;
+  int warmup = 50;
+  int steps = 200;
+  printf("vehicles motors functions    bank\n");
+  for (int num_vehicles=1; num_vehicles<=max_vehicles; num_vehicles*=2) {
+    double step_time[2];
+    int num_motors = 0;
+    for (int batched=0; batched<2; batched++) {
+      chrono::ChSystemNSC sys;
+      setupSystem(sys, 1);
+      auto material = createMaterial(chrono::ChContactMethod::NSC);
+      FloatingOrigin origin(1.0, 2.0);
+      Terrain terrain(sys, material, -0.2, 1.0, num_vehicles * spacing + 1.5, 2, 4);
+      terrain.margin = margin;
+      terrain.envelope = envelope;
+      terrain.family = 1;
+      terrain.update(origin, 0.0);
+      std::vector<Vehicle> fleet = addFleet(sys, material, num_vehicles, 1.0, true, true);
+      MotorBank *bank = batched ? createMotorBank(fleet) : NULL;
+      num_motors = 3 * num_vehicles;
+
+      chrono::ChTimer timer;
+      for (int i=0; i<warmup+steps; i++) {
+        if (i == warmup)
+          timer.start();
+        origin.update(sys, *fleet[0].body);
+        terrain.update(origin, fleet[0].body->GetPos().x());
+        if (bank)
+          bank->update();
+        sys.DoStepDynamics(dt);
+      };
+      timer.stop();
+      delete bank;
+      step_time[batched] = 1000.0 * timer.GetTimeSeconds() / steps;
+    };
+    printf("%8d %6d %9.3f %7.3f\n", num_vehicles, num_motors, step_time[0], step_time[1]);
+    fflush(stdout);
+  };
+  return 0;
+}
 
-      glDrawElementsInstanced(GL_POINTS, 1, GL_UNSIGNED_INT, (void *)0, num_points);
+// Compare the switching and the regularised brake law at increasing step sizes while a vehicle brakes to a stop.
+// The sign changes of the wheel speeds per simulated second measure the chatter.
+int brakes(void)
+{
+  double steps[] = {0.0025, 0.005, 0.01, 0.02, 0.04};
+  double duration = 30.0;
+  printf("law       dt     ms/step ms/second events/s   x_final\n");
+  for (int smooth=0; smooth<2; smooth++)
+    for (int i=0; i<5; i++) {
+      double dt = steps[i];
+      int n = (int)round(duration / dt);
+      chrono::ChSystemNSC sys;
+      setupSystem(sys, 1);
+      auto material = createMaterial(chrono::ChContactMethod::NSC);
+      FloatingOrigin origin(1.0, 2.0);
+      Terrain terrain(sys, material, -0.2, 1.0, spacing + 1.5, 2, 4);
+      terrain.margin = margin;
+      terrain.envelope = envelope;
+      terrain.family = 1;
+      terrain.update(origin, 0.0);
+      Vehicle vehicle = addFleet(sys, material, 1, 1.0, true, smooth)[0];
+      BrakeEvents events;
+      for (auto motor=vehicle.motors.begin(); motor!=vehicle.motors.end(); motor++)
+        events.add(*motor);
+
+      chrono::ChTimer timer;
+      timer.start();
+      for (int k=0; k<n; k++) {
+        origin.update(sys, *vehicle.body);
+        terrain.update(origin, vehicle.body->GetPos().x());
+        sys.DoStepDynamics(dt);
+        events.update();
+      };
+      timer.stop();
+      double step_time = 1000.0 * timer.GetTimeSeconds() / n;
+      printf("%-9s %-6g %7.3f %9.1f %8.2f %9.3f\n", smooth ? "smooth" : "switching", dt, step_time, step_time / dt,
+             events.events / duration, vehicle.body->GetPos().x() + origin.origin.x());
+      fflush(stdout);
     };
+  return 0;
+}
+
+int main(int argc, char *argv[])
+{
+  if (argc > 1 && !strcmp(argv[1], "--benchmark"))
+    return benchmark(argc > 2 ? atoi(argv[2]) : 16);
+  if (argc > 1 && !strcmp(argv[1], "--brakes"))
+    return brakes();
+  if (argc > 1 && !strcmp(argv[1], "--motors"))
+    return motors(argc > 2 ? atoi(argv[2]) : 64);
+  if (scalingOption(argc, argv, "gears", createScene, 0.01, 500))
+    return 0;
+  if (autotuneOption(argc, argv, "gears", createScene, 0.01, 200))
+    return 0;
+  if (backendOption(argc, argv, "gears", createBackendScene, 5.0))
+    return 0;
+  if (collisionOption(argc, argv, "gears", createCollisionScene, 1, 64, 0.01, 200))
+    return 0;
+  bool analytic = false;
+  bool smooth_brake = true;
+  const char *cosim = NULL;
+  for (int i=1; i<argc; i++) {
+    if (!strcmp(argv[i], "--cosim"))
+      cosim = i + 1 < argc && argv[i + 1][0] == '/' ? argv[i + 1] : "/gears";
+    if (!strcmp(argv[i], "--analytic"))
+      analytic = true;
+    if (!strcmp(argv[i], "--switching-brake"))
+      smooth_brake = false;
+  };
+  int num_vehicles = argc > 1 && argv[1][0] != '-' ? atoi(argv[1]) : 1;
+  if (num_vehicles < 1) {
+    fprintf(stderr, "Usage: %s [number of vehicles (at least 1)] [options]\n", argv[0]);
+    return 1;
+  };
+  if (cosim && num_vehicles * 9 > COSIM_MAX_VALUES) {
+    fprintf(stderr, "Co-simulation supports at most %d vehicles\n", COSIM_MAX_VALUES / 9);
+    return 1;
+  };
+  CosimChannel *channel = cosim ? new CosimChannel(cosim, true) : NULL;
+  if (channel && !channel->valid())
+    return 1;
+
+  glfwInit();
+  GLFWwindow *window = glfwCreateWindow(width, height, "Vehicle with gears with Project Chrono", NULL, NULL);
+  glfwMakeContextCurrent(window);
+  glewInit();
+
+  glClearColor(0.1f, 0.1f, 0.1f, 0.0f);
+  glViewport(0, 0, width, height);
+
+  Program program_cuboid = createProgram(vertex_cuboid, fragment_cuboid);
+
+  GLuint vao_cuboid;
+  GLuint vbo_cuboid;
+  GLuint idx_cuboid;
+
+  glGenVertexArrays(1, &vao_cuboid);
+  glBindVertexArray(vao_cuboid);
+
+  glGenBuffers(1, &vbo_cuboid);
+  glBindBuffer(GL_ARRAY_BUFFER, vbo_cuboid);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(vertices_cuboid), vertices_cuboid, GL_STATIC_DRAW);
+  glGenBuffers(1, &idx_cuboid);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, idx_cuboid);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices_cuboid), indices_cuboid, GL_STATIC_DRAW);
+
+  glUseProgram(program_cuboid.program);
+
+  glVertexAttribPointer(glGetAttribLocation(program_cuboid.program, "point"),
+                        3, GL_FLOAT, GL_FALSE,
+                        6 * sizeof(float), (void *)0);
+  glVertexAttribPointer(glGetAttribLocation(program_cuboid.program, "normal"),
+                        3, GL_FLOAT, GL_FALSE,
+                        6 * sizeof(float), (void *)(3 * sizeof(float)));
+
+  glEnableVertexAttribArray(0);
+  glEnableVertexAttribArray(1);
+
+  float light[3] = {0.36f, 0.8f, -0.48f};
+  GLuint globals = createGlobals();
+  attachGlobals(program_cuboid);
+  // Scale z so that the outer vehicles of a large fleet stay within the clip volume
+  float depth = 1.0f / std::max(1.0f, (float)(0.5 * (num_vehicles - 1) * spacing + 0.5));
+  updateGlobals(globals, (float)width / (float)height, light, depth);
+  float axes[3] = {a, b, c};
+  glUniform3fv(program_cuboid.axes, 1, axes);
+
+  int num_points = 18;
+  WheelRenderer *wheel_renderer = new WheelRenderer(num_points, 3 * num_vehicles);
+
+  glDisable(GL_CULL_FACE);
+  glEnable(GL_DEPTH_TEST);
+  glPointSize(2.0f);
+
+  float max_dt = 0.02;
+
+  std::shared_ptr<chrono::ChSystem> system = createContactSystem(contactMethodOption(argc, argv));
+  chrono::ChSystem &sys = *system;
+  setupSystem(sys, 1);
+  sys.SetCollisionSystemType(collisionSystemOption(argc, argv));
+
+  // Simulating a frame should take at most half of a 60 Hz frame.
+  // The governor starts from the iteration budget of the profile if there is one.
+  Governor governor(0.5 / 60.0, 5, 50, 1, 8);
+  SolverProfile profile;
+  if (useProfile("gears", sys, 0.0, &profile))
+    governor.iterations = std::max(governor.min_iterations, std::min(profile.iterations, governor.max_iterations));
+  governor.apply(sys);
+
+  auto material = createMaterial(sys.GetContactMethod());
+
+  // Road tiles around the vehicles replace a single large ground box
+  FloatingOrigin origin(1.0, 2.0);
+  Terrain terrain(sys, material, -0.2, 1.0, num_vehicles * spacing + 1.5, 2, 4);
+  terrain.margin = margin;
+  terrain.envelope = envelope;
+  terrain.family = 1;
+  terrain.update(origin, 0.0);
+
+  std::vector<Vehicle> fleet = addFleet(sys, material, num_vehicles, 1.0, !analytic, smooth_brake);
+  WheelContact *contact = analytic ? createWheelContact(terrain, origin, fleet) : NULL;
+  MotorBank *bank;
+  if (channel)
+    bank = createCosimBank(*channel, sys, origin, fleet);
+  else
+    bank = smooth_brake ? createMotorBank(fleet) : NULL;
+  for (auto vehicle=fleet.begin(); vehicle!=fleet.end(); vehicle++)
+    for (auto wheel=vehicle->wheels.begin(); wheel!=vehicle->wheels.end(); wheel++)
+      wheel_renderer->add(*wheel, radius, length);
+  auto body = fleet[0].body;
+  ContactLog contact_log(argc, argv);
+  TelemetryPublisher *telemetry = telemetryOption(argc, argv, "gears");
+  int channel_x = telemetry ? telemetry->add("x") : -1;
+  int channel_speed = telemetry ? telemetry->add("speed") : -1;
+  int channel_torque[3];
+  for (int i=0; i<3; i++)
+    channel_torque[i] = telemetry ? telemetry->add((std::string("torque_") + std::to_string(i)).c_str()) : -1;
+
+  DrawList draws;
+
+  double t = glfwGetTime();
+  while (!glfwWindowShouldClose(window)) {
+    double dt = glfwGetTime() - t;
+    if (dt > max_dt) dt = max_dt;
+
+    origin.update(sys, *body);
+    terrain.update(origin, body->GetPos().x());
+
+    glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
+
+    draws.clear();
+    for (auto vehicle=fleet.begin(); vehicle!=fleet.end(); vehicle++)
+      draws.add(program_cuboid, vao_cuboid, GL_QUADS, 24, *vehicle->body);
+    draws.submit();
+    wheel_renderer->draw();
 
     glfwSwapBuffers(window);
     glfwPollEvents();
+    double start = glfwGetTime();
+    int n = governor.substeps;
     for (int i=0; i<n; i++) {
+      if (bank)
+        bank->update();
+      if (contact)
+        contact->update(dt / n);
       sys.DoStepDynamics(dt / n);
+      contact_log.update(sys);
+      if (telemetry) {
+        telemetry->set(channel_x, body->GetPos().x() + origin.origin.x());
+        telemetry->set(channel_speed, body->GetPosDt().x());
+        for (int j=0; j<3; j++)
+          telemetry->set(channel_torque[j], fleet[0].motors[j]->GetMotorTorque());
+        telemetry->publish(sys.GetChTime());
+      };
     }
+    governor.update(sys, glfwGetTime() - start);
     t += dt;
   };
 
@@ -462,17 +652,13 @@ int main(void)
   glDeleteBuffers(1, &vbo_cuboid);
   glDeleteVertexArrays(1, &vao_cuboid);
 
-  glDeleteBuffers(1, &idx_wheel);
-  glDeleteBuffers(1, &vbo_wheel);
-  glDeleteVertexArrays(1, &vao_wheel);
-
-  glDeleteProgram(program_wheel);
-  glDeleteShader(vertex_shader_wheel);
-  glDeleteShader(fragment_shader_wheel);
-
-  glDeleteProgram(program_cuboid);
-  glDeleteShader(vertex_shader_cuboid);
-  glDeleteShader(fragment_shader_cuboid);
+  delete telemetry;
+  delete bank;
+  delete channel;
+  delete contact;
+  deleteGlobals(globals);
+  delete wheel_renderer;
+  deleteProgram(program_cuboid);
 
   glfwTerminate();
   return 0;
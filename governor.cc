@@ -0,0 +1,43 @@
+#include <cstdio>
+#include "governor.hh"
+
+Governor::Governor(double target, int min_iterations, int max_iterations, int min_substeps, int max_substeps):
+  target(target), min_iterations(min_iterations), max_iterations(max_iterations), min_substeps(min_substeps),
+  max_substeps(max_substeps), iterations(max_iterations), substeps(min_substeps), average(0.0), frames(0)
+{
+}
+
+void Governor::apply(chrono::ChSystem &sys)
+{
+  auto solver = sys.GetSolver()->AsIterative();
+  if (solver)
+    solver->SetMaxIterations(iterations);
+}
+
+void Governor::update(chrono::ChSystem &sys, double elapsed)
+{
+  average = frames == 0 ? elapsed : 0.9 * average + 0.1 * elapsed;
+  if (++frames < 30)
+    return;
+  int previous_iterations = iterations;
+  int previous_substeps = substeps;
+  if (average > target) {
+    if (substeps > min_substeps)
+      substeps--;
+    else if (iterations > min_iterations)
+      iterations = iterations * 3 / 4 > min_iterations ? iterations * 3 / 4 : min_iterations;
+  } else if (average < 0.6 * target) {
+    if (iterations < max_iterations)
+      iterations = iterations * 5 / 4 + 1 < max_iterations ? iterations * 5 / 4 + 1 : max_iterations;
+    else if (substeps < max_substeps)
+      substeps++;
+  };
+  if (iterations == previous_iterations && substeps == previous_substeps)
+    return;
+  // Start averaging afresh with the new budget
+  frames = 0;
+  apply(sys);
+  auto solver = sys.GetSolver()->AsIterative();
+  printf("governor: %d substeps, %d iterations, %.2f ms per frame on average (target %.2f ms), residual %g\n",
+         substeps, iterations, 1000.0 * average, 1000.0 * target, solver ? solver->GetError() : 0.0);
+}
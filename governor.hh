@@ -0,0 +1,27 @@
+#pragma once
+#include <chrono/physics/ChSystem.h>
+
+// Real-time governor for the solver iteration budget and the number of substeps per frame.
+// If simulating a frame takes longer than the target time, substeps are removed first and then iterations.
+// If there is time to spare, iterations are added first and then substeps.
+// The budget is changed at most every 30 frames. Every change is logged with the average time per frame and the solver residual, i.e. the accuracy given up.
+class Governor {
+public:
+  Governor(double target, int min_iterations, int max_iterations, int min_substeps, int max_substeps);
+
+  // Set the iteration budget of the iterative solver
+  void apply(chrono::ChSystem &sys);
+  // Adjust the budget using the wall-clock time taken to simulate the last frame
+  void update(chrono::ChSystem &sys, double elapsed);
+
+  double target;
+  int min_iterations;
+  int max_iterations;
+  int min_substeps;
+  int max_substeps;
+  int iterations;
+  int substeps;
+  // Exponential moving average of the time per frame and number of frames since the last change
+  double average;
+  int frames;
+};
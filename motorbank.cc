@@ -0,0 +1,27 @@
+#include "motorbank.hh"
+
+MotorBank::MotorBank(ControlLaw law):
+  law(law)
+{
+}
+
+void MotorBank::add(std::shared_ptr<chrono::ChLinkMotorRotationTorque> motor, double parameter)
+{
+  auto function = chrono_types::make_shared<chrono::ChFunctionConst>(0.0);
+  motor->SetTorqueFunction(function);
+  motors.push_back(motor);
+  functions.push_back(function);
+  parameters.push_back(parameter);
+  speeds.push_back(0.0);
+  torques.push_back(0.0);
+}
+
+void MotorBank::update(void)
+{
+  int n = motors.size();
+  for (int i=0; i<n; i++)
+    speeds[i] = motors[i]->GetMotorAngleDt();
+  law(n, speeds.data(), parameters.data(), torques.data());
+  for (int i=0; i<n; i++)
+    functions[i]->SetConstant(torques[i]);
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include <functional>
+#include <memory>
+#include <vector>
+#include <chrono/functions/ChFunctionConst.h>
+#include <chrono/physics/ChLinkMotorRotationTorque.h>
+
+// Control law computing the torques of all motors of a bank from their speeds and a parameter per motor
+typedef std::function<void(int n, const double *speeds, const double *parameters, double *torques)> ControlLaw;
+
+// Batched controller for many torque motors.
+// The torque function of each motor is replaced with a constant which is written once per step,
+// so the motors do not call back into a controller object during the step.
+// "update" reads all motor speeds into one array, evaluates the control law on the whole array and writes the torques back.
+class MotorBank {
+public:
+  MotorBank(ControlLaw law);
+
+  void add(std::shared_ptr<chrono::ChLinkMotorRotationTorque> motor, double parameter);
+  // Set the motor torques for the next step from the current speeds
+  void update(void);
+
+  ControlLaw law;
+  std::vector<std::shared_ptr<chrono::ChLinkMotorRotationTorque>> motors;
+  std::vector<std::shared_ptr<chrono::ChFunctionConst>> functions;
+  std::vector<double> speeds;
+  std::vector<double> parameters;
+  std::vector<double> torques;
+};
@@ -7,12 +7,16 @@
 #include <chrono/physics/ChSystemNSC.h>
 #include <chrono/physics/ChLoadsBody.h>
 #include <chrono/physics/ChLoadContainer.h>
+#include "renderer.hh"
+#include "scaling.hh"
+#include "autotune.hh"
+#include "telemetry.hh"
+#include "conservation.hh"
 
 int width = 640;
 int height = 480;
 
-const char *vertexSource = "#version 410 core\n\
-uniform float aspect;\n\
+const char *vertexSource = "#version 410 core\n" GLOBALS_BLOCK "\
 uniform vec3 translation;\n\
 in vec3 point;\n\
 void main()\n\
@@ -35,30 +39,6 @@ unsigned int indices[] = {
    0
 };
 
-void handleCompileError(const char *step, GLuint shader)
-{
-  GLint result = GL_FALSE;
-  glGetShaderiv(shader, GL_COMPILE_STATUS, &result);
-  if (result == GL_FALSE) {
-    char buffer[1024];
-    glGetShaderInfoLog(shader, 1024, NULL, buffer);
-    if (buffer[0])
-      fprintf(stderr, "%s: %s\n", step, buffer);
-  };
-}
-
-void handleLinkError(const char *step, GLuint program)
-{
-  GLint result = GL_FALSE;
-  glGetProgramiv(program, GL_LINK_STATUS, &result);
-  if (result == GL_FALSE) {
-    char buffer[1024];
-    glGetProgramInfoLog(program, 1024, NULL, buffer);
-    if (buffer[0])
-      fprintf(stderr, "%s: %s\n", step, buffer);
-  };
-}
-
 class ChLoadGravity: public chrono::ChLoadBodyBody
 {
   public:
@@ -77,8 +57,63 @@ class ChLoadGravity: public chrono::ChLoadBodyBody
     virtual bool IsStiff(void) {return false; }
 };
 
-int main(void)
+void setupSystem(chrono::ChSystemNSC &sys)
 {
+  sys.SetGravitationalAcceleration(chrono::ChVector3(0.0, 0.0, 0.0));
+  sys.SetTimestepperType(chrono::ChTimestepper::Type::RUNGEKUTTA45);
+}
+
+// Particle orbiting a fixed center under inverse-square gravity
+std::shared_ptr<chrono::ChBody> addOrbit(chrono::ChSystemNSC &sys)
+{
+  auto center = chrono_types::make_shared<chrono::ChBody>();
+  center->SetName("center");
+  center->SetMass(1.0e+3);
+  center->SetInertiaXX(chrono::ChVector3(1000.0f, 1000.0f, 1000.0f));
+  center->SetPos(chrono::ChVector3(0.0, 0.0, 0.0));
+  center->SetPosDt(chrono::ChVector3(0.0, 0.0, 0.0));
+  center->SetFixed(true);
+  sys.AddBody(center);
+
+  auto body = chrono_types::make_shared<chrono::ChBody>();
+  body->SetName("particle");
+  body->SetMass(10.0);
+  body->SetInertiaXX(chrono::ChVector3(1.0f, 1.0f, 1.0f));
+  body->SetPos(chrono::ChVector3(0.5, 0.0, 0.0));
+  body->SetPosDt(chrono::ChVector3(0.0, 0.2, 0.0));
+  body->SetFixed(false);
+  sys.AddBody(body);
+
+  auto load_container = chrono_types::make_shared<chrono::ChLoadContainer>();
+  sys.Add(load_container);
+  auto gravity = chrono_types::make_shared<ChLoadGravity>(body, center);
+  load_container->Add(gravity);
+  return body;
+}
+
+// Potential energy of a body in the central force field of ChLoadGravity
+double orbitPotential(const chrono::ChBody &body)
+{
+  return -0.05 * body.GetMass() / body.GetPos().Length();
+}
+
+Scene createScene(void)
+{
+  auto sys = chrono_types::make_shared<chrono::ChSystemNSC>();
+  setupSystem(*sys);
+  addOrbit(*sys);
+  return Scene{sys};
+}
+
+int main(int argc, char *argv[])
+{
+  if (scalingOption(argc, argv, "orbit", createScene, 0.01, 1000))
+    return 0;
+  if (autotuneOption(argc, argv, "orbit", createScene, 0.01, 200))
+    return 0;
+  if (driftOption(argc, argv, "orbit", createScene, orbitPotential, 1e-3, 1e-3))
+    return 0;
+
   glfwInit();
   glfwWindowHint(GLFW_DEPTH_BITS, 0);
   GLFWwindow *window = glfwCreateWindow(width, height, "Orbiting mass with Project Chrono", NULL, NULL);
@@ -88,21 +123,7 @@ int main(void)
   glClearColor(0.1f, 0.1f, 0.1f, 0.0f);
   glViewport(0, 0, width, height);
 
-  GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
-  glShaderSource(vertexShader, 1, &vertexSource, NULL);
-  glCompileShader(vertexShader);
-  handleCompileError("Vertex shader", vertexShader);
-
-  GLuint fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-  glShaderSource(fragmentShader, 1, &fragmentSource, NULL);
-  glCompileShader(fragmentShader);
-  handleCompileError("Fragment shader", fragmentShader);
-
-  GLuint program = glCreateProgram();
-  glAttachShader(program, vertexShader);
-  glAttachShader(program, fragmentShader);
-  glLinkProgram(program);
-  handleLinkError("Shader program", program);
+  Program program = createProgram(vertexSource, fragmentSource);
 
   GLuint vao;
   GLuint vbo;
@@ -118,9 +139,9 @@ int main(void)
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, idx);
   glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
 
-  glUseProgram(program);
+  glUseProgram(program.program);
 
-  glVertexAttribPointer(glGetAttribLocation(program, "point"),
+  glVertexAttribPointer(glGetAttribLocation(program.program, "point"),
                         3, GL_FLOAT, GL_FALSE,
                         3 * sizeof(float), (void *)0);
 
@@ -128,48 +149,48 @@ int main(void)
 
   glPointSize(2.0f);
 
-  glUniform1f(glGetUniformLocation(program, "aspect"), (float)width / (float)height);
+  float light[3] = {0.36f, 0.8f, -0.48f};
+  GLuint globals = createGlobals();
+  attachGlobals(program);
+  updateGlobals(globals, (float)width / (float)height, light);
 
   chrono::ChSystemNSC sys;
-  sys.SetGravitationalAcceleration(chrono::ChVector3(0.0, 0.0, 0.0));
-  sys.SetTimestepperType(chrono::ChTimestepper::Type::RUNGEKUTTA45);
-
-  auto center = chrono_types::make_shared<chrono::ChBody>();
-  center->SetName("center");
-  center->SetMass(1.0e+3);
-  center->SetInertiaXX(chrono::ChVector3(1000.0f, 1000.0f, 1000.0f));
-  center->SetPos(chrono::ChVector3(0.0, 0.0, 0.0));
-  center->SetPosDt(chrono::ChVector3(0.0, 0.0, 0.0));
-  center->SetFixed(true);
-  sys.AddBody(center);
-
-  auto body = chrono_types::make_shared<chrono::ChBody>();
-  body->SetName("particle");
-  body->SetMass(10.0);
-  body->SetInertiaXX(chrono::ChVector3(1.0f, 1.0f, 1.0f));
-  body->SetPos(chrono::ChVector3(0.5, 0.0, 0.0));
-  body->SetPosDt(chrono::ChVector3(0.0, 0.2, 0.0));
-  body->SetFixed(false);
-  sys.AddBody(body);
-
-  auto load_container = chrono_types::make_shared<chrono::ChLoadContainer>();
-  sys.Add(load_container);
-  auto gravity = chrono_types::make_shared<ChLoadGravity>(body, center);
-  load_container->Add(gravity);
+  setupSystem(sys);
+  useProfile("orbit", sys);
+  auto body = addOrbit(sys);
+  TelemetryPublisher *telemetry = telemetryOption(argc, argv, "orbit");
+  int channel_x = telemetry ? telemetry->add("x") : -1;
+  int channel_y = telemetry ? telemetry->add("y") : -1;
+  int channel_kinetic = telemetry ? telemetry->add("kinetic_energy") : -1;
+  int channel_potential = telemetry ? telemetry->add("potential_energy") : -1;
+  int channel_energy = telemetry ? telemetry->add("energy") : -1;
+  ConservationMonitor *monitor = conservationOption(argc, argv, sys, orbitPotential, 1e-3, 1e-3);
+
+  DrawList draws;
 
   double t = glfwGetTime();
   while (!glfwWindowShouldClose(window)) {
     double dt = glfwGetTime() - t;
 
-    chrono::ChVector3 position = body->GetPos();
-    float translation[3] = {(float)position.x(), (float)position.y(), (float)position.z()};
-    glUniform3fv(glGetUniformLocation(program, "translation"), 1, translation);
-
     // glClear(GL_COLOR_BUFFER_BIT);
-    glDrawElements(GL_POINTS, 1, GL_UNSIGNED_INT, (void *)0);
+    draws.clear();
+    draws.add(program, vao, GL_POINTS, 1, *body);
+    draws.submit();
     glfwSwapBuffers(window);
     glfwPollEvents();
     sys.DoStepDynamics(dt);
+    if (monitor)
+      monitor->update();
+    if (telemetry) {
+      double kinetic = 0.5 * body->GetMass() * body->GetPosDt().Length2();
+      double potential = orbitPotential(*body);
+      telemetry->set(channel_x, body->GetPos().x());
+      telemetry->set(channel_y, body->GetPos().y());
+      telemetry->set(channel_kinetic, kinetic);
+      telemetry->set(channel_potential, potential);
+      telemetry->set(channel_energy, kinetic + potential);
+      telemetry->publish(sys.GetChTime());
+    };
     t += dt;
   };
 
@@ -180,9 +201,10 @@ int main(void)
   glBindVertexArray(0);
   glDeleteVertexArrays(1, &vao);
 
-  glDeleteProgram(program);
-  glDeleteShader(vertexShader);
-  glDeleteShader(fragmentShader);
+  delete monitor;
+  delete telemetry;
+  deleteGlobals(globals);
+  deleteProgram(program);
 
   glfwTerminate();
   return 0;
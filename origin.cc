@@ -0,0 +1,27 @@
+#include <cmath>
+#include "origin.hh"
+
+FloatingOrigin::FloatingOrigin(double threshold, double step):
+  threshold(threshold), step(step), origin(0.0, 0.0, 0.0)
+{
+}
+
+bool FloatingOrigin::update(chrono::ChSystem &sys, const chrono::ChBody &tracked)
+{
+  double x = tracked.GetPos().x();
+  if (x >= -threshold && x < threshold)
+    return false;
+  double k = floor((x + threshold) / step);
+  shift(sys, chrono::ChVector3d(k * step, 0.0, 0.0));
+  return true;
+}
+
+void FloatingOrigin::shift(chrono::ChSystem &sys, const chrono::ChVector3d &offset)
+{
+  for (auto body=sys.GetBodies().begin(); body!=sys.GetBodies().end(); body++)
+    (*body)->SetPos((*body)->GetPos() - offset);
+  origin += offset;
+  // Recompute absolute link frames and markers from the shifted bodies.
+  // Collision models are synchronised at the beginning of the next step.
+  sys.Update(false);
+}
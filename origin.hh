@@ -0,0 +1,20 @@
+#pragma once
+#include <chrono/physics/ChBody.h>
+#include <chrono/physics/ChSystem.h>
+
+// Floating origin keeping a long-running simulation near the origin of the coordinate system.
+// When the tracked body leaves [-threshold, threshold) along x, all bodies are shifted back by a multiple of "step".
+// Link frames, markers and collision models are attached to the bodies and follow them.
+// "origin" holds the world position of the current local origin.
+class FloatingOrigin {
+public:
+  FloatingOrigin(double threshold, double step);
+
+  // Rebase if necessary and return true if the bodies were shifted.
+  bool update(chrono::ChSystem &sys, const chrono::ChBody &tracked);
+  void shift(chrono::ChSystem &sys, const chrono::ChVector3d &offset);
+
+  double threshold;
+  double step;
+  chrono::ChVector3d origin;
+};
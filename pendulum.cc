@@ -1,5 +1,8 @@
 #include <cmath>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
 #include <vector>
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
@@ -7,12 +10,28 @@
 #include <chrono/physics/ChBody.h>
 #include <chrono/physics/ChSystemNSC.h>
 #include <chrono/physics/ChLinkRevolute.h>
+#include "renderer.hh"
+#include "pose.hh"
+#include "scaling.hh"
+#include "autotune.hh"
 
 int width = 1280;
 int height = 720;
 
-const char *vertexSource = "#version 410 core\n\
-uniform float aspect;\n\
+const double a = 0.5;
+const double b = 0.05;
+const double c = 0.05;
+
+// Ensemble members start with angles perturbed by up to "ensemble_spread" and are compared with a shadow copy
+// whose lower angle is offset by "ensemble_d0". A member has diverged when the phase space distance
+// to its shadow exceeds "ensemble_threshold".
+const double ensemble_spread = 0.05;
+const double ensemble_d0 = 1e-6;
+const double ensemble_threshold = 0.1;
+const double ensemble_dt = 0.01;
+const double ensemble_duration = 60.0;
+
+const char *vertexSource = "#version 410 core\n" GLOBALS_BLOCK "\
 uniform vec3 axes;\n\
 uniform vec3 translation;\n\
 uniform mat3 rotation;\n\
@@ -25,8 +44,25 @@ void main()\n\
   gl_Position = vec4((rotation * (point * axes) + translation) * vec3(1, aspect, 1), 1);\n\
 }";
 
-const char *fragmentSource = "#version 410 core\n\
-uniform vec3 light;\n\
+// Instanced variant of the cuboid shader for drawing ensembles
+const char *vertexEnsemble = "#version 410 core\n" GLOBALS_BLOCK "\
+uniform vec3 axes;\n\
+layout(location = 0) in vec3 point;\n\
+layout(location = 1) in vec3 normal;\n\
+in vec3 translation;\n\
+in vec4 rotation;\n\
+out vec3 n;\n\
+vec3 rotate(vec4 q, vec3 v)\n\
+{\n\
+  return v + 2.0 * cross(q.yzw, cross(q.yzw, v) + q.x * v);\n\
+}\n\
+void main()\n\
+{\n\
+  n = rotate(rotation, normal);\n\
+  gl_Position = vec4((rotate(rotation, point * axes) + translation) * vec3(1, aspect, 1), 1);\n\
+}";
+
+const char *fragmentSource = "#version 410 core\n" GLOBALS_BLOCK "\
 in vec3 n;\n\
 out vec3 fragColor;\n\
 void main()\n\
@@ -84,32 +120,217 @@ unsigned int indices[] = {
   20, 21, 22, 23
 };
 
-void handleCompileError(const char *step, GLuint shader)
+void setupSystem(chrono::ChSystemNSC &sys)
 {
-  GLint result = GL_FALSE;
-  glGetShaderiv(shader, GL_COMPILE_STATUS, &result);
-  if (result == GL_FALSE) {
-    char buffer[1024];
-    glGetShaderInfoLog(shader, 1024, NULL, buffer);
-    if (buffer[0])
-      fprintf(stderr, "%s: %s\n", step, buffer);
-  };
+  sys.SetTimestepperType(chrono::ChTimestepper::Type::EULER_IMPLICIT_PROJECTED);
+  sys.SetSolverType(chrono::ChSolver::Type::PSOR);
+  sys.GetSolver()->AsIterative()->SetMaxIterations(100);
+  sys.SetGravitationalAcceleration(chrono::ChVector3(0.0, -0.4, 0.0));
 }
 
-void handleLinkError(const char *step, GLuint program)
+struct Pendulum {
+  std::shared_ptr<chrono::ChBody> base;
+  std::shared_ptr<chrono::ChBody> upper;
+  std::shared_ptr<chrono::ChBody> lower;
+};
+
+// Double pendulum of two cuboids attached to a fixed base with revolute joints.
+// The angles of the links are measured counterclockwise from the x axis.
+Pendulum addPendulum(chrono::ChSystemNSC &sys, double angle_upper = 0.0, double angle_lower = 0.0)
 {
-  GLint result = GL_FALSE;
-  glGetProgramiv(program, GL_LINK_STATUS, &result);
-  if (result == GL_FALSE) {
-    char buffer[1024];
-    glGetProgramInfoLog(program, 1024, NULL, buffer);
-    if (buffer[0])
-      fprintf(stderr, "%s: %s\n", step, buffer);
+  Pendulum pendulum;
+
+  auto base = chrono_types::make_shared<chrono::ChBody>();
+  base->SetFixed(true);
+  base->SetMass(10.0);
+  base->SetInertiaXX(chrono::ChVector3(1, 1, 1));
+  base->SetPos(chrono::ChVector3(0.0, 0.5, 0.0));
+  sys.AddBody(base);
+  pendulum.base = base;
+
+  float mass = 10.0;
+  chrono::ChVector3d direction_upper(cos(angle_upper), sin(angle_upper), 0.0);
+  chrono::ChVector3d direction_lower(cos(angle_lower), sin(angle_lower), 0.0);
+  chrono::ChVector3d joint = base->GetPos() + direction_upper * a;
+
+  auto upper = chrono_types::make_shared<chrono::ChBody>();
+  upper->SetMass(mass);
+  upper->SetInertiaXX(chrono::ChVector3(mass * (b * b + c * c) / 12.0,
+                                        mass * (a * a + c * c) / 12.0,
+                                        mass * (a * a + b * b) / 12.0));
+  upper->SetPos(base->GetPos() + direction_upper * (0.5 * a));
+  upper->SetRot(chrono::QuatFromAngleZ(angle_upper));
+  sys.AddBody(upper);
+  pendulum.upper = upper;
+
+  auto lower = chrono_types::make_shared<chrono::ChBody>();
+  lower->SetMass(mass);
+  lower->SetInertiaXX(chrono::ChVector3(mass * (b * b + c * c) / 12.0,
+                                        mass * (a * a + c * c) / 12.0,
+                                        mass * (a * a + b * b) / 12.0));
+  lower->SetPos(joint + direction_lower * (0.5 * a));
+  lower->SetRot(chrono::QuatFromAngleZ(angle_lower));
+  sys.AddBody(lower);
+  pendulum.lower = lower;
+
+  auto link1 = chrono_types::make_shared<chrono::ChLinkRevolute>();
+  link1->Initialize(base, upper, chrono::ChFrame<>(base->GetPos(), chrono::QUNIT));
+  sys.AddLink(link1);
+
+  auto link2 = chrono_types::make_shared<chrono::ChLinkRevolute>();
+  link2->Initialize(upper, lower, chrono::ChFrame<>(joint, chrono::QUNIT));
+  sys.AddLink(link2);
+  return pendulum;
+}
+
+// Phase space state (link angles and angular velocities)
+void pendulumState(const Pendulum &pendulum, double state[4])
+{
+  chrono::ChVector3d upper = pendulum.upper->GetPos() - pendulum.base->GetPos();
+  chrono::ChVector3d lower = pendulum.lower->GetPos() - pendulum.upper->GetPos() - upper;
+  state[0] = atan2(upper.y(), upper.x());
+  state[1] = atan2(lower.y(), lower.x());
+  state[2] = pendulum.upper->GetAngVelParent().z();
+  state[3] = pendulum.lower->GetAngVelParent().z();
+}
+
+double pendulumDistance(const Pendulum &p, const Pendulum &q)
+{
+  double x[4];
+  double y[4];
+  pendulumState(p, x);
+  pendulumState(q, y);
+  double d0 = remainder(x[0] - y[0], 2 * M_PI);
+  double d1 = remainder(x[1] - y[1], 2 * M_PI);
+  double d2 = x[2] - y[2];
+  double d3 = x[3] - y[3];
+  return sqrt(d0 * d0 + d1 * d1 + d2 * d2 + d3 * d3);
+}
+
+// Ensemble member with its own system and a shadow system for measuring the divergence of nearby trajectories
+struct Member {
+  std::shared_ptr<chrono::ChSystemNSC> sys;
+  std::shared_ptr<chrono::ChSystemNSC> shadow_sys;
+  Pendulum pendulum;
+  Pendulum shadow;
+  double angle_upper;
+  double angle_lower;
+  double time;
+  double distance;
+  bool diverged;
+};
+
+Member createMember(int index)
+{
+  std::mt19937 random(index);
+  std::uniform_real_distribution<double> perturbation(-ensemble_spread, ensemble_spread);
+  Member member;
+  member.angle_upper = perturbation(random);
+  member.angle_lower = perturbation(random);
+  member.sys = chrono_types::make_shared<chrono::ChSystemNSC>();
+  setupSystem(*member.sys);
+  member.sys->SetNumThreads(1, 1, 1);
+  member.pendulum = addPendulum(*member.sys, member.angle_upper, member.angle_lower);
+  member.shadow_sys = chrono_types::make_shared<chrono::ChSystemNSC>();
+  setupSystem(*member.shadow_sys);
+  member.shadow_sys->SetNumThreads(1, 1, 1);
+  member.shadow = addPendulum(*member.shadow_sys, member.angle_upper, member.angle_lower + ensemble_d0);
+  member.time = 0.0;
+  member.distance = ensemble_d0;
+  member.diverged = false;
+  return member;
+}
+
+// Step member and shadow and return true if the member diverged in this step.
+// A diverged member keeps moving without its shadow, and its divergence time and distance are kept.
+bool stepMember(Member &member, double dt)
+{
+  member.sys->DoStepDynamics(dt);
+  if (member.diverged)
+    return false;
+  member.shadow_sys->DoStepDynamics(dt);
+  member.time += dt;
+  member.distance = pendulumDistance(member.pendulum, member.shadow);
+  member.diverged = member.distance > ensemble_threshold;
+  return member.diverged;
+}
+
+// Finite-time Lyapunov exponent from the growth of the distance to the shadow
+double lyapunov(const Member &member)
+{
+  return log(member.distance / ensemble_d0) / member.time;
+}
+
+void printMember(int index, const Member &member)
+{
+  printf("%d,%.6f,%.6f,%d,%.4f,%.6f\n", index, member.angle_upper, member.angle_lower, member.diverged,
+         member.time, lyapunov(member));
+  fflush(stdout);
+}
+
+// Simulate ensemble members in parallel and stream a CSV line per member followed by summary statistics
+int runEnsemble(int size)
+{
+  printf("member,angle_upper,angle_lower,diverged,divergence_time,lyapunov\n");
+  int num_diverged = 0;
+  double sum_time = 0.0;
+  double sum_time2 = 0.0;
+  double sum_lyapunov = 0.0;
+  double sum_lyapunov2 = 0.0;
+  #pragma omp parallel for schedule(dynamic)
+  for (int i=0; i<size; i++) {
+    Member member = createMember(i);
+    while (member.time < ensemble_duration && !stepMember(member, ensemble_dt));
+    double l = lyapunov(member);
+    #pragma omp critical
+    {
+      printMember(i, member);
+      if (member.diverged) {
+        num_diverged++;
+        sum_time += member.time;
+        sum_time2 += member.time * member.time;
+      };
+      sum_lyapunov += l;
+      sum_lyapunov2 += l * l;
+    }
+  };
+  double mean_lyapunov = sum_lyapunov / size;
+  printf("# members %d, diverged %d\n", size, num_diverged);
+  if (num_diverged > 0) {
+    double mean_time = sum_time / num_diverged;
+    printf("# divergence time mean %.4f, std %.4f\n", mean_time, sqrt(fmax(sum_time2 / num_diverged - mean_time * mean_time, 0.0)));
   };
+  printf("# lyapunov mean %.6f, std %.6f\n", mean_lyapunov,
+         sqrt(fmax(sum_lyapunov2 / size - mean_lyapunov * mean_lyapunov, 0.0)));
+  return 0;
 }
 
-int main(void)
+Scene createScene(void)
 {
+  auto sys = chrono_types::make_shared<chrono::ChSystemNSC>();
+  setupSystem(*sys);
+  addPendulum(*sys);
+  return Scene{sys};
+}
+
+int main(int argc, char *argv[])
+{
+  if (scalingOption(argc, argv, "pendulum", createScene, 0.01, 1000))
+    return 0;
+  if (autotuneOption(argc, argv, "pendulum", createScene, 0.01, 200))
+    return 0;
+
+  int ensemble_size = 0;
+  if (argc > 1 && !strcmp(argv[1], "--ensemble")) {
+    ensemble_size = argc > 2 ? atoi(argv[2]) : 1000;
+    if (ensemble_size < 1) {
+      fprintf(stderr, "Usage: %s --ensemble [size (at least 1)] [--draw]\n", argv[0]);
+      return 1;
+    };
+    if (argc < 4 || strcmp(argv[3], "--draw"))
+      return runEnsemble(ensemble_size);
+  };
+
   glfwInit();
   GLFWwindow *window = glfwCreateWindow(width, height, "Double pendulum with Project Chrono", NULL, NULL);
   glfwMakeContextCurrent(window);
@@ -118,21 +339,7 @@ int main(void)
   glClearColor(0.1f, 0.1f, 0.1f, 0.0f);
   glViewport(0, 0, width, height);
 
-  GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
-  glShaderSource(vertexShader, 1, &vertexSource, NULL);
-  glCompileShader(vertexShader);
-  handleCompileError("Vertex shader", vertexShader);
-
-  GLuint fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-  glShaderSource(fragmentShader, 1, &fragmentSource, NULL);
-  glCompileShader(fragmentShader);
-  handleCompileError("Fragment shader", fragmentShader);
-
-  GLuint program = glCreateProgram();
-  glAttachShader(program, vertexShader);
-  glAttachShader(program, fragmentShader);
-  glLinkProgram(program);
-  handleLinkError("Shader program", program);
+  Program program = createProgram(vertexSource, fragmentSource);
 
   GLuint vao;
   GLuint vbo;
@@ -148,12 +355,12 @@ int main(void)
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, idx);
   glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
 
-  glUseProgram(program);
+  glUseProgram(program.program);
 
-  glVertexAttribPointer(glGetAttribLocation(program, "point"),
+  glVertexAttribPointer(glGetAttribLocation(program.program, "point"),
                         3, GL_FLOAT, GL_FALSE,
                         6 * sizeof(float), (void *)0);
-  glVertexAttribPointer(glGetAttribLocation(program, "normal"),
+  glVertexAttribPointer(glGetAttribLocation(program.program, "normal"),
                         3, GL_FLOAT, GL_FALSE,
                         6 * sizeof(float), (void *)(3 * sizeof(float)));
 
@@ -164,52 +371,36 @@ int main(void)
   glEnable(GL_DEPTH_TEST);
 
   float light[3] = {0.36f, 0.8f, -0.48f};
-  glUniform3fv(glGetUniformLocation(program, "light"), 1, light);
-  glUniform1f(glGetUniformLocation(program, "aspect"), (float)width / (float)height);
-  double a = 0.5;
-  double b = 0.05;
-  double c = 0.05;
+  GLuint globals = createGlobals();
+  attachGlobals(program);
+  updateGlobals(globals, (float)width / (float)height, light);
   float axes[3] = {(float)a, (float)b, (float)c};
-  glUniform3fv(glGetUniformLocation(program, "axes"), 1, axes);
+  glUniform3fv(program.axes, 1, axes);
 
   chrono::ChSystemNSC sys;
-  sys.SetTimestepperType(chrono::ChTimestepper::Type::EULER_IMPLICIT_PROJECTED);
-  sys.SetSolverType(chrono::ChSolver::Type::PSOR);
-  sys.GetSolver()->AsIterative()->SetMaxIterations(100);
-  sys.SetGravitationalAcceleration(chrono::ChVector3(0.0, -0.4, 0.0));
-
-  auto base = chrono_types::make_shared<chrono::ChBody>();
-  base->SetFixed(true);
-  base->SetMass(10.0);
-  base->SetInertiaXX(chrono::ChVector3(1, 1, 1));
-  base->SetPos(chrono::ChVector3(0.0, 0.5, 0.0));
-  sys.AddBody(base);
-
-  float mass = 10.0;
-
-  auto upper = chrono_types::make_shared<chrono::ChBody>();
-  upper->SetMass(mass);
-  upper->SetInertiaXX(chrono::ChVector3(mass * (b * b + c * c) / 12.0,
-                                        mass * (a * a + c * c) / 12.0,
-                                        mass * (a * a + b * b) / 12.0));
-  upper->SetPos(chrono::ChVector3(0.5 * a, 0.5, 0.0));
-  sys.AddBody(upper);
-
-  auto lower = chrono_types::make_shared<chrono::ChBody>();
-  lower->SetMass(mass);
-  lower->SetInertiaXX(chrono::ChVector3(mass * (b * b + c * c) / 12.0,
-                                        mass * (a * a + c * c) / 12.0,
-                                        mass * (a * a + b * b) / 12.0));
-  lower->SetPos(chrono::ChVector3(1.5 * a, 0.5, 0.0));
-  sys.AddBody(lower);
-
-  auto link1 = chrono_types::make_shared<chrono::ChLinkRevolute>();
-  link1->Initialize(base, upper, chrono::ChFrame<>(base->GetPos(), chrono::QUNIT));
-  sys.AddLink(link1);
-
-  auto link2 = chrono_types::make_shared<chrono::ChLinkRevolute>();
-  link2->Initialize(upper, lower, chrono::ChFrame<>(chrono::ChVector3(a, 0.5, 0.0), chrono::QUNIT));
-  sys.AddLink(link2);
+  setupSystem(sys);
+  useProfile("pendulum", sys);
+  addPendulum(sys);
+
+  DrawList draws;
+
+  // Ensemble members are stepped in lockstep and all links are drawn with one instanced call
+  std::vector<Member> members;
+  std::vector<std::shared_ptr<chrono::ChBody>> links;
+  for (int i=0; i<ensemble_size; i++) {
+    members.push_back(createMember(i));
+    links.push_back(members.back().pendulum.upper);
+    links.push_back(members.back().pendulum.lower);
+  };
+  Program program_ensemble = createProgram(vertexEnsemble, fragmentSource);
+  attachGlobals(program_ensemble);
+  glUseProgram(program_ensemble.program);
+  glUniform3fv(program_ensemble.axes, 1, axes);
+  GLint translation = glGetAttribLocation(program_ensemble.program, "translation");
+  GLint rotation = glGetAttribLocation(program_ensemble.program, "rotation");
+  PoseBuffer *poses = new PoseBuffer(2 * ensemble_size + 1);
+  if (ensemble_size > 0)
+    printf("member,angle_upper,angle_lower,diverged,divergence_time,lyapunov\n");
 
   double t = glfwGetTime();
   while (!glfwWindowShouldClose(window)) {
@@ -217,36 +408,39 @@ int main(void)
 
     glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
 
-    for (auto body=sys.GetBodies().begin(); body!=sys.GetBodies().end(); body++) {
-      if ((*body)->IsFixed()) continue;
-
-      chrono::ChQuaternion quat = (*body)->GetRot();
-      chrono::ChMatrix33 mat(quat);
-      chrono::ChVector3 x = mat.GetAxisX();
-      chrono::ChVector3 y = mat.GetAxisY();
-      chrono::ChVector3 z = mat.GetAxisZ();
-
-      float rotation[9] = {
-        (float)x.x(), (float)y.x(), (float)z.x(),
-        (float)x.y(), (float)y.y(), (float)z.y(),
-        (float)x.z(), (float)y.z(), (float)z.z()
+    if (ensemble_size > 0) {
+      poses->update(links);
+      glUseProgram(program_ensemble.program);
+      glBindVertexArray(vao);
+      poses->bindAttributes(translation, rotation);
+      glDrawElementsInstanced(GL_QUADS, 24, GL_UNSIGNED_INT, (void *)0, poses->count);
+      poses->fence();
+    } else {
+      draws.clear();
+      for (auto body=sys.GetBodies().begin(); body!=sys.GetBodies().end(); body++) {
+        if ((*body)->IsFixed()) continue;
+        draws.add(program, vao, GL_QUADS, 24, **body);
       };
-
-      glUniformMatrix3fv(glGetUniformLocation(program, "rotation"), 1, GL_TRUE, rotation);
-
-      chrono::ChVector3 position = (*body)->GetPos();
-      float translation[3] = {(float)position.x(), (float)position.y(), (float)position.z()};
-      glUniform3fv(glGetUniformLocation(program, "translation"), 1, translation);
-
-      glDrawElements(GL_QUADS, 24, GL_UNSIGNED_INT, (void *)0);
+      draws.submit();
     };
 
     glfwSwapBuffers(window);
     glfwPollEvents();
-    sys.DoStepDynamics(dt);
+    if (ensemble_size > 0) {
+      #pragma omp parallel for schedule(dynamic)
+      for (int i=0; i<ensemble_size; i++)
+        if (stepMember(members[i], ensemble_dt)) {
+          #pragma omp critical
+          printMember(i, members[i]);
+        };
+    } else
+      sys.DoStepDynamics(dt);
     t += dt;
   };
 
+  delete poses;
+  deleteProgram(program_ensemble);
+
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
   glDeleteBuffers(1, &idx);
   glBindBuffer(GL_ARRAY_BUFFER, 0);
@@ -254,9 +448,8 @@ int main(void)
   glBindVertexArray(0);
   glDeleteVertexArrays(1, &vao);
 
-  glDeleteProgram(program);
-  glDeleteShader(vertexShader);
-  glDeleteShader(fragmentShader);
+  deleteGlobals(globals);
+  deleteProgram(program);
 
   glfwTerminate();
   return 0;
@@ -0,0 +1,99 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include "telemetry.hh"
+
+// Reader for the telemetry of a scene started with "--telemetry".
+// Without options all channels are written to stdout as CSV.
+// "--plot <channel>" draws a scrolling bar plot of one channel in the terminal instead,
+// with one line per "--interval" seconds of simulated time (default 0.05).
+// The reader exits when no records arrive for 10 seconds.
+
+const int plot_width = 60;
+
+int main(int argc, char *argv[])
+{
+  const char *name = "/suspension";
+  const char *plot = NULL;
+  double interval = 0.05;
+  for (int i=1; i<argc; i++) {
+    if (argv[i][0] == '/')
+      name = argv[i];
+    else if (!strcmp(argv[i], "--plot") && i + 1 < argc)
+      plot = argv[++i];
+    else if (!strcmp(argv[i], "--interval") && i + 1 < argc)
+      interval = atof(argv[++i]);
+  };
+
+  // Wait for the scene to create the segment
+  TelemetryReader *reader = NULL;
+  for (int i=0; i<100; i++) {
+    reader = new TelemetryReader(name);
+    if (reader->valid())
+      break;
+    delete reader;
+    reader = NULL;
+    usleep(100000);
+  };
+  if (!reader || !reader->wait(10000)) {
+    fprintf(stderr, "%s: no telemetry\n", name);
+    delete reader;
+    return 1;
+  };
+
+  int num_channels = reader->numChannels();
+  int channel = -1;
+  if (plot) {
+    for (int i=0; i<num_channels; i++)
+      if (!strcmp(reader->channelName(i), plot))
+        channel = i;
+    if (channel < 0) {
+      fprintf(stderr, "%s: no channel %s\n", name, plot);
+      delete reader;
+      return 1;
+    };
+  } else {
+    printf("time");
+    for (int i=0; i<num_channels; i++)
+      printf(",%s", reader->channelName(i));
+    printf("\n");
+  };
+
+  double time;
+  double values[TELEMETRY_MAX_CHANNELS];
+  double lower = INFINITY;
+  double upper = -INFINITY;
+  double next_line = -INFINITY;
+  int idle = 0;
+  while (idle < 1000) {
+    if (!reader->next(time, values)) {
+      fflush(stdout);
+      usleep(10000);
+      idle++;
+      continue;
+    };
+    idle = 0;
+    if (plot) {
+      double value = values[channel];
+      if (value < lower) lower = value;
+      if (value > upper) upper = value;
+      if (time < next_line)
+        continue;
+      next_line = time + interval;
+      int bar = upper > lower ? (int)round((value - lower) / (upper - lower) * plot_width) : 0;
+      printf("%10.3f %12.5g |%s\n", time, value, std::string(bar, '#').c_str());
+    } else {
+      printf("%g", time);
+      for (int i=0; i<num_channels; i++)
+        printf(",%g", values[i]);
+      printf("\n");
+    };
+  };
+  if (reader->lost > 0)
+    fprintf(stderr, "%s: %lu records lost\n", name, (unsigned long)reader->lost);
+  delete reader;
+  return 0;
+}
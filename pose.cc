@@ -0,0 +1,134 @@
+#include <cstring>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+#include "pose.hh"
+
+// Add offset to three doubles and convert them to floats
+static inline void convertVector(const double *src, const double *offset, float *dst)
+{
+#ifdef __SSE2__
+  __m128 xy = _mm_cvtpd_ps(_mm_add_pd(_mm_loadu_pd(src), _mm_loadu_pd(offset)));
+  _mm_storel_pi((__m64 *)dst, xy);
+  dst[2] = (float)(src[2] + offset[2]);
+#else
+  dst[0] = (float)(src[0] + offset[0]);
+  dst[1] = (float)(src[1] + offset[1]);
+  dst[2] = (float)(src[2] + offset[2]);
+#endif
+}
+
+// Convert four doubles to floats
+static inline void convertQuaternion(const double *src, float *dst)
+{
+#if defined(__AVX__)
+  _mm_storeu_ps(dst, _mm256_cvtpd_ps(_mm256_loadu_pd(src)));
+#elif defined(__SSE2__)
+  __m128 lo = _mm_cvtpd_ps(_mm_loadu_pd(src));
+  __m128 hi = _mm_cvtpd_ps(_mm_loadu_pd(src + 2));
+  _mm_storeu_ps(dst, _mm_movelh_ps(lo, hi));
+#else
+  dst[0] = (float)src[0];
+  dst[1] = (float)src[1];
+  dst[2] = (float)src[2];
+  dst[3] = (float)src[3];
+#endif
+}
+
+PoseBuffer::PoseBuffer(int capacity):
+  capacity(capacity), count(0), region(0), mapped(NULL)
+{
+  memset(fences, 0, sizeof(fences));
+  persistent = GLEW_ARB_buffer_storage;
+  num_regions = persistent ? 3 : 1;
+  GLsizeiptr size = num_regions * capacity * 7 * sizeof(float);
+  glGenBuffers(1, &vbo);
+  glBindBuffer(GL_ARRAY_BUFFER, vbo);
+  if (persistent) {
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glBufferStorage(GL_ARRAY_BUFFER, size, NULL, flags);
+    mapped = (float *)glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+  } else
+    glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STREAM_DRAW);
+}
+
+PoseBuffer::~PoseBuffer()
+{
+  for (int i=0; i<num_regions; i++)
+    if (fences[i])
+      glDeleteSync(fences[i]);
+  glBindBuffer(GL_ARRAY_BUFFER, vbo);
+  if (persistent)
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glDeleteBuffers(1, &vbo);
+}
+
+float *PoseBuffer::begin(void)
+{
+  if (persistent) {
+    if (fences[region]) {
+      glClientWaitSync(fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+      glDeleteSync(fences[region]);
+      fences[region] = 0;
+    };
+    return mapped + region * capacity * 7;
+  };
+  glBindBuffer(GL_ARRAY_BUFFER, vbo);
+  return (float *)glMapBufferRange(GL_ARRAY_BUFFER, 0, capacity * 7 * sizeof(float),
+                                   GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+}
+
+void PoseBuffer::write(float *region, int index, const chrono::ChBody &body, const chrono::ChVector3d &offset)
+{
+  convertVector(body.GetPos().data(), offset.data(), region + 3 * index);
+  convertQuaternion(body.GetRot().data(), region + 3 * capacity + 4 * index);
+}
+
+void PoseBuffer::end(int count)
+{
+  this->count = count;
+  if (!persistent) {
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+  };
+}
+
+int PoseBuffer::update(const std::vector<std::shared_ptr<chrono::ChBody>> &bodies, const chrono::ChVector3d &offset)
+{
+  float *region = begin();
+  int index = 0;
+  for (auto body=bodies.begin(); body!=bodies.end() && index<capacity; body++) {
+    if ((*body)->IsFixed()) continue;
+    write(region, index++, **body, offset);
+  };
+  end(index);
+  return count;
+}
+
+void PoseBuffer::bindAttributes(GLint translation, GLint rotation)
+{
+  size_t offset = region * capacity * 7 * sizeof(float);
+  glBindBuffer(GL_ARRAY_BUFFER, vbo);
+  if (translation >= 0) {
+    glVertexAttribPointer(translation, 3, GL_FLOAT, GL_FALSE, 0, (void *)offset);
+    glVertexAttribDivisor(translation, 1);
+    glEnableVertexAttribArray(translation);
+  };
+  if (rotation >= 0) {
+    glVertexAttribPointer(rotation, 4, GL_FLOAT, GL_FALSE, 0, (void *)(offset + 3 * capacity * sizeof(float)));
+    glVertexAttribDivisor(rotation, 1);
+    glEnableVertexAttribArray(rotation);
+  };
+}
+
+void PoseBuffer::fence(void)
+{
+  if (persistent) {
+    fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    region = (region + 1) % num_regions;
+  };
+}
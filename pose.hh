@@ -0,0 +1,43 @@
+#pragma once
+#include <memory>
+#include <vector>
+#include <GL/glew.h>
+#include <chrono/physics/ChBody.h>
+
+// Instance buffer holding the poses of a list of bodies as packed float32 arrays.
+// The buffer is split into regions, each holding "capacity" translations (vec3) followed by
+// "capacity" rotation quaternions (vec4, scalar part first).
+// If persistent mapping is available the regions are cycled and guarded with fences,
+// otherwise a single region is mapped for writing each frame.
+class PoseBuffer {
+public:
+  PoseBuffer(int capacity);
+  ~PoseBuffer();
+
+  // Convert the poses of all non-fixed bodies (translated by offset) and write them to the current region.
+  // Returns the number of instances written.
+  int update(const std::vector<std::shared_ptr<chrono::ChBody>> &bodies,
+             const chrono::ChVector3d &offset = chrono::ChVector3d(0, 0, 0));
+
+  // Map the current region for writing, store poses at arbitrary instance indices and set the instance count when done.
+  float *begin(void);
+  void write(float *region, int index, const chrono::ChBody &body, const chrono::ChVector3d &offset);
+  void end(int count);
+
+  // Point the instanced vertex attributes at the current region (vertex array must be bound).
+  void bindAttributes(GLint translation, GLint rotation);
+
+  // Mark the current region as in use by the GPU and advance to the next one.
+  void fence(void);
+
+  int capacity;
+  int count;
+  GLuint vbo;
+
+protected:
+  int num_regions;
+  int region;
+  bool persistent;
+  float *mapped;
+  GLsync fences[3];
+};
@@ -0,0 +1,159 @@
+#include <algorithm>
+#include <cstdio>
+#include <chrono/core/ChQuaternion.h>
+#include "renderer.hh"
+
+void handleCompileError(const char *step, GLuint shader)
+{
+  GLint result = GL_FALSE;
+  glGetShaderiv(shader, GL_COMPILE_STATUS, &result);
+  if (result == GL_FALSE) {
+    char buffer[1024];
+    glGetShaderInfoLog(shader, 1024, NULL, buffer);
+    if (buffer[0])
+      fprintf(stderr, "%s: %s\n", step, buffer);
+  };
+}
+
+void handleLinkError(const char *step, GLuint program)
+{
+  GLint result = GL_FALSE;
+  glGetProgramiv(program, GL_LINK_STATUS, &result);
+  if (result == GL_FALSE) {
+    char buffer[1024];
+    glGetProgramInfoLog(program, 1024, NULL, buffer);
+    if (buffer[0])
+      fprintf(stderr, "%s: %s\n", step, buffer);
+  };
+}
+
+Program createProgram(const char *vertex_source, const char *fragment_source)
+{
+  Program result;
+
+  result.vertex_shader = glCreateShader(GL_VERTEX_SHADER);
+  glShaderSource(result.vertex_shader, 1, &vertex_source, NULL);
+  glCompileShader(result.vertex_shader);
+  handleCompileError("Vertex shader", result.vertex_shader);
+
+  result.fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
+  glShaderSource(result.fragment_shader, 1, &fragment_source, NULL);
+  glCompileShader(result.fragment_shader);
+  handleCompileError("Fragment shader", result.fragment_shader);
+
+  result.program = glCreateProgram();
+  glAttachShader(result.program, result.vertex_shader);
+  glAttachShader(result.program, result.fragment_shader);
+  glLinkProgram(result.program);
+  handleLinkError("Shader program", result.program);
+
+  result.translation = glGetUniformLocation(result.program, "translation");
+  result.rotation = glGetUniformLocation(result.program, "rotation");
+  result.axes = glGetUniformLocation(result.program, "axes");
+  result.radius = glGetUniformLocation(result.program, "radius");
+  result.num_points = glGetUniformLocation(result.program, "num_points");
+  return result;
+}
+
+void deleteProgram(const Program &program)
+{
+  glDeleteProgram(program.program);
+  glDeleteShader(program.vertex_shader);
+  glDeleteShader(program.fragment_shader);
+}
+
+GLuint createGlobals(void)
+{
+  GLuint ubo;
+  glGenBuffers(1, &ubo);
+  glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+  glBufferData(GL_UNIFORM_BUFFER, 8 * sizeof(float), NULL, GL_DYNAMIC_DRAW);
+  glBindBufferBase(GL_UNIFORM_BUFFER, 0, ubo);
+  return ubo;
+}
+
+void attachGlobals(const Program &program)
+{
+  GLuint index = glGetUniformBlockIndex(program.program, "Globals");
+  if (index != GL_INVALID_INDEX)
+    glUniformBlockBinding(program.program, index, 0);
+}
+
+void updateGlobals(GLuint ubo, float aspect, const float light[3], float depth)
+{
+  // std140 layout: vec3 light followed by float aspect in the same 16 bytes, then float depth
+  float data[5] = {light[0], light[1], light[2], aspect, depth};
+  glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+  glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(data), data);
+}
+
+void deleteGlobals(GLuint ubo)
+{
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  glDeleteBuffers(1, &ubo);
+}
+
+void bodyPose(const chrono::ChBody &body, double dx, float rotation[9], float translation[3])
+{
+  chrono::ChMatrix33 mat(body.GetRot());
+  chrono::ChVector3 x = mat.GetAxisX();
+  chrono::ChVector3 y = mat.GetAxisY();
+  chrono::ChVector3 z = mat.GetAxisZ();
+
+  rotation[0] = (float)x.x(); rotation[1] = (float)y.x(); rotation[2] = (float)z.x();
+  rotation[3] = (float)x.y(); rotation[4] = (float)y.y(); rotation[5] = (float)z.y();
+  rotation[6] = (float)x.z(); rotation[7] = (float)y.z(); rotation[8] = (float)z.z();
+
+  chrono::ChVector3 position = body.GetPos();
+  translation[0] = (float)(position.x() + dx);
+  translation[1] = (float)position.y();
+  translation[2] = (float)position.z();
+}
+
+Draw &DrawList::add(const Program &program, GLuint vao, GLenum mode, GLsizei count, GLsizei instances)
+{
+  Draw draw = {&program, vao, mode, count, instances, {1, 0, 0, 0, 1, 0, 0, 0, 1}, {0, 0, 0}};
+  draws.push_back(draw);
+  return draws.back();
+}
+
+Draw &DrawList::add(const Program &program, GLuint vao, GLenum mode, GLsizei count, const chrono::ChBody &body, double dx)
+{
+  Draw &draw = add(program, vao, mode, count);
+  bodyPose(body, dx, draw.rotation, draw.translation);
+  return draw;
+}
+
+void DrawList::submit(void)
+{
+  std::stable_sort(draws.begin(), draws.end(), [](const Draw &a, const Draw &b) {
+    if (a.program->program != b.program->program)
+      return a.program->program < b.program->program;
+    return a.vao < b.vao;
+  });
+  const Program *program = NULL;
+  GLuint vao = 0;
+  for (auto draw=draws.begin(); draw!=draws.end(); draw++) {
+    if (draw->program != program) {
+      program = draw->program;
+      glUseProgram(program->program);
+    };
+    if (draw->vao != vao) {
+      vao = draw->vao;
+      glBindVertexArray(vao);
+    };
+    if (program->rotation >= 0)
+      glUniformMatrix3fv(program->rotation, 1, GL_TRUE, draw->rotation);
+    if (program->translation >= 0)
+      glUniform3fv(program->translation, 1, draw->translation);
+    if (draw->instances == 1)
+      glDrawElements(draw->mode, draw->count, GL_UNSIGNED_INT, (void *)0);
+    else
+      glDrawElementsInstanced(draw->mode, draw->count, GL_UNSIGNED_INT, (void *)0, draw->instances);
+  };
+}
+
+void DrawList::clear(void)
+{
+  draws.clear();
+}
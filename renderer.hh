@@ -0,0 +1,62 @@
+#pragma once
+#include <vector>
+#include <GL/glew.h>
+#include <chrono/physics/ChBody.h>
+
+// Declaration of the uniform block shared by all programs. Prepend it to the shader source after the version line.
+// "depth" scales world z into the clip volume for scenes extending further than one unit along z.
+#define GLOBALS_BLOCK "layout(std140) uniform Globals {\n  vec3 light;\n  float aspect;\n  float depth;\n};\n"
+
+void handleCompileError(const char *step, GLuint shader);
+
+void handleLinkError(const char *step, GLuint program);
+
+// Shader program with its uniform locations resolved once after linking (-1 if not used by the program)
+struct Program {
+  GLuint program;
+  GLuint vertex_shader;
+  GLuint fragment_shader;
+  GLint translation;
+  GLint rotation;
+  GLint axes;
+  GLint radius;
+  GLint num_points;
+};
+
+Program createProgram(const char *vertex_source, const char *fragment_source);
+
+void deleteProgram(const Program &program);
+
+// Uniform buffer with the per-frame globals (light direction, aspect ratio and depth scale)
+GLuint createGlobals(void);
+
+void attachGlobals(const Program &program);
+
+void updateGlobals(GLuint ubo, float aspect, const float light[3], float depth = 1.0f);
+
+void deleteGlobals(GLuint ubo);
+
+// Rotation matrix (row major) and translation of a body for the per-object uniforms
+void bodyPose(const chrono::ChBody &body, double dx, float rotation[9], float translation[3]);
+
+struct Draw {
+  const Program *program;
+  GLuint vao;
+  GLenum mode;
+  GLsizei count;
+  GLsizei instances;
+  float rotation[9];
+  float translation[3];
+};
+
+// Draw calls of a frame. The list is sorted by program and vertex array object when submitted
+// so that state is only changed when the next draw call needs it.
+class DrawList {
+public:
+  Draw &add(const Program &program, GLuint vao, GLenum mode, GLsizei count, GLsizei instances = 1);
+  Draw &add(const Program &program, GLuint vao, GLenum mode, GLsizei count, const chrono::ChBody &body, double dx = 0.0);
+  void submit(void);
+  void clear(void);
+
+  std::vector<Draw> draws;
+};
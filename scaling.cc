@@ -0,0 +1,101 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <thread>
+#include <chrono/core/ChTimer.h>
+#include "scaling.hh"
+
+static double stepTime(SceneFactory create, double dt, int steps, int chrono, int collision, int eigen)
+{
+  Scene scene = create();
+  scene.sys->SetNumThreads(chrono, collision, eigen);
+  int warmup = steps / 10;
+  chrono::ChTimer timer;
+  for (int i=0; i<warmup+steps; i++) {
+    if (i == warmup)
+      timer.start();
+    if (scene.update)
+      scene.update();
+    scene.sys->DoStepDynamics(dt);
+  };
+  timer.stop();
+  return 1000.0 * timer.GetTimeSeconds() / steps;
+}
+
+int scaling(const char *name, SceneFactory create, double dt, int steps, int max_threads)
+{
+  if (max_threads <= 0)
+    max_threads = std::thread::hardware_concurrency();
+  if (max_threads <= 0)
+    max_threads = 1;
+  const char *pools[] = {"all", "collision", "chrono", "eigen"};
+  printf("%s: %d steps of %g s\n", name, steps, dt);
+  printf("pool      threads ms/step speedup efficiency\n");
+  double reference = stepTime(create, dt, steps, 1, 1, 1);
+  for (int pool=0; pool<4; pool++) {
+    for (int threads=1; threads<=max_threads; threads*=2) {
+      double step_time = threads == 1 ? reference :
+        stepTime(create, dt, steps,
+                 pool == 0 || pool == 2 ? threads : 1,
+                 pool == 0 || pool == 1 ? threads : 1,
+                 pool == 0 || pool == 3 ? threads : 1);
+      double speedup = reference / step_time;
+      printf("%-9s %7d %7.3f %7.2f %9.1f%%\n", pools[pool], threads, step_time, speedup, 100.0 * speedup / threads);
+    };
+  };
+  return 0;
+}
+
+bool scalingOption(int argc, char *argv[], const char *name, SceneFactory create, double dt, int steps)
+{
+  if (argc < 2 || strcmp(argv[1], "--scaling"))
+    return false;
+  scaling(name, create, dt, steps, argc > 2 ? atoi(argv[2]) : 0);
+  return true;
+}
+
+double trial(SceneFactory create, double dt, int steps, std::vector<chrono::ChVector3d> &positions,
+             std::function<void(chrono::ChSystem &sys)> observe)
+{
+  positions.clear();
+  try {
+    Scene scene = create();
+    chrono::ChTimer timer;
+    for (int i=0; i<steps; i++) {
+      timer.start();
+      if (scene.update)
+        scene.update();
+      scene.sys->DoStepDynamics(dt);
+      timer.stop();
+      if (observe)
+        observe(*scene.sys);
+    };
+    chrono::ChVector3d origin = scene.origin ? scene.origin() : chrono::ChVector3d(0, 0, 0);
+    for (auto body=scene.sys->GetBodies().begin(); body!=scene.sys->GetBodies().end(); body++) {
+      if ((*body)->IsFixed()) continue;
+      chrono::ChVector3d position = (*body)->GetPos() + origin;
+      if (!std::isfinite(position.x()) || !std::isfinite(position.y()) || !std::isfinite(position.z()))
+        return -1.0;
+      positions.push_back(position);
+    };
+    return 1000.0 * timer.GetTimeSeconds() / steps;
+  } catch (std::exception &) {
+    return -1.0;
+  };
+}
+
+double rmsError(const std::vector<chrono::ChVector3d> &positions, const std::vector<chrono::ChVector3d> &reference)
+{
+  if (positions.size() != reference.size())
+    return INFINITY;
+  if (positions.empty())
+    return 0.0;
+  double sum = 0.0;
+  for (unsigned int i=0; i<positions.size(); i++) {
+    chrono::ChVector3d difference = positions[i] - reference[i];
+    sum += difference.x() * difference.x() + difference.y() * difference.y() + difference.z() * difference.z();
+  };
+  return sqrt(sum / positions.size());
+}
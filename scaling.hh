@@ -0,0 +1,34 @@
+#pragma once
+#include <functional>
+#include <memory>
+#include <vector>
+#include <chrono/physics/ChSystem.h>
+
+// Headless scene for benchmarking. "update" is optional and called before each step (e.g. to stream terrain).
+// "origin" is optional and returns the world position of the local origin if the scene uses a floating origin.
+// "sys" is declared first so that objects captured by "update" and "origin" are released before the system.
+struct Scene {
+  std::shared_ptr<chrono::ChSystem> sys;
+  std::function<void(void)> update;
+  std::function<chrono::ChVector3d(void)> origin;
+};
+
+typedef std::function<Scene(void)> SceneFactory;
+
+// Step a fresh instance of the scene with 1, 2, 4, ... threads and print the step time, speedup and parallel efficiency.
+// The thread count is varied for all pools together and for the collision, Chrono and Eigen pools individually.
+// If max_threads is zero, the hardware concurrency is used.
+int scaling(const char *name, SceneFactory create, double dt, int steps, int max_threads = 0);
+
+// Run the scaling report if the first command line argument is "--scaling" and return true in that case.
+bool scalingOption(int argc, char *argv[], const char *name, SceneFactory create, double dt, int steps);
+
+// Step an instance of the scene and return the time per step (scene update and step) in milliseconds,
+// or a negative value if the simulation failed (an exception or a position which is not finite).
+// "observe" is optional and called after each step outside of the timing.
+// The final world positions of the moving bodies are stored in "positions".
+double trial(SceneFactory create, double dt, int steps, std::vector<chrono::ChVector3d> &positions,
+             std::function<void(chrono::ChSystem &sys)> observe = nullptr);
+
+// RMS distance between corresponding positions (infinite if the numbers of positions differ)
+double rmsError(const std::vector<chrono::ChVector3d> &positions, const std::vector<chrono::ChVector3d> &reference);
@@ -0,0 +1,51 @@
+#include <cstring>
+#include "solverlog.hh"
+
+void configureIterativeSolver(chrono::ChSystem &sys, int max_iterations, double tolerance)
+{
+  auto solver = sys.GetSolver()->AsIterative();
+  if (!solver)
+    return;
+  solver->SetMaxIterations(max_iterations);
+  solver->SetTolerance(tolerance);
+  solver->EnableWarmStart(true);
+}
+
+SolverLog::SolverLog(int argc, char *argv[]):
+  file(NULL), steps(0), total_iterations(0), max_iterations(0), max_residual(0.0)
+{
+  for (int i=1; i<argc-1; i++)
+    if (!strcmp(argv[i], "--solver-log")) {
+      file = fopen(argv[i + 1], "w");
+      if (!file)
+        perror(argv[i + 1]);
+      else
+        fprintf(file, "time iterations residual\n");
+    };
+}
+
+SolverLog::~SolverLog()
+{
+  if (file)
+    fclose(file);
+  if (steps > 0)
+    printf("solver: %ld steps, %.1f iterations on average, %d at most, largest residual %g\n",
+           steps, (double)total_iterations / steps, max_iterations, max_residual);
+}
+
+void SolverLog::update(chrono::ChSystem &sys)
+{
+  auto solver = sys.GetSolver()->AsIterative();
+  if (!solver)
+    return;
+  int iterations = solver->GetIterations();
+  double residual = solver->GetError();
+  steps++;
+  total_iterations += iterations;
+  if (iterations > max_iterations)
+    max_iterations = iterations;
+  if (residual > max_residual)
+    max_residual = residual;
+  if (file)
+    fprintf(file, "%g %d %g\n", sys.GetChTime(), iterations, residual);
+}
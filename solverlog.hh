@@ -0,0 +1,25 @@
+#pragma once
+#include <cstdio>
+#include <chrono/physics/ChSystem.h>
+
+// Warm start the iterative solver from the impulses of the previous step and stop iterating once the
+// residual drops below the tolerance. Direct solvers are left unchanged.
+void configureIterativeSolver(chrono::ChSystem &sys, int max_iterations, double tolerance);
+
+// Iteration counts and final residuals of the iterative solver.
+// With "--solver-log <file>" on the command line a line "time iterations residual" is written per step.
+// A summary is printed when the log is destroyed.
+class SolverLog {
+public:
+  SolverLog(int argc, char *argv[]);
+  ~SolverLog();
+
+  // Record the solver statistics of the last step
+  void update(chrono::ChSystem &sys);
+
+  FILE *file;
+  long steps;
+  long total_iterations;
+  int max_iterations;
+  double max_residual;
+};
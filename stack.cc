@@ -1,31 +1,63 @@
 #include <cmath>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <vector>
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #include <chrono/core/ChQuaternion.h>
 #include <chrono/physics/ChBody.h>
 #include <chrono/physics/ChSystemNSC.h>
+#include <chrono/physics/ChSystemSMC.h>
+#include "renderer.hh"
+#include "pose.hh"
+#include "culling.hh"
+#include "scaling.hh"
+#include "autotune.hh"
+#include "solverlog.hh"
+#include "diagnostics.hh"
+#include "backend.hh"
 
 int width = 1280;
 int height = 720;
 
-const char *vertexSource = "#version 410 core\n\
-uniform float aspect;\n\
+const float a = 1.0;
+const float b = 0.1;
+const float c = 0.5;
+
+// Residual at which the warm started solver stops iterating (kept when a profile replaces the solver)
+const double solver_tolerance = 1e-4;
+
+// Number of boxes for the scaling report
+const int scaling_count = 192;
+
+// Bodies moving slower than these thresholds for "sleep_time" seconds are put to sleep.
+// Chrono wakes sleeping bodies again when they touch moving ones.
+const float sleep_time = 0.5f;
+const float sleep_lin_vel = 0.05f;
+const float sleep_ang_vel = 0.05f;
+
+// Safe margins and envelopes of the boxes and of the ground unless overridden by "stack.margins"
+const std::vector<ShapeMargins> default_margins = {{"box", 0.1f, 0.001f}, {"ground", 0.1f, 0.001f}};
+
+const char *vertexSource = "#version 410 core\n" GLOBALS_BLOCK "\
 uniform vec3 axes;\n\
-uniform vec3 translation;\n\
-uniform mat3 rotation;\n\
 in vec3 point;\n\
 in vec3 normal;\n\
+in vec3 translation;\n\
+in vec4 rotation;\n\
 out vec3 n;\n\
+vec3 rotate(vec4 q, vec3 v)\n\
+{\n\
+  return v + 2.0 * cross(q.yzw, cross(q.yzw, v) + q.x * v);\n\
+}\n\
 void main()\n\
 {\n\
-  n = rotation * normal;\n\
-  gl_Position = vec4((rotation * (point * axes) + translation) * vec3(1, aspect, 1), 1);\n\
+  n = rotate(rotation, normal);\n\
+  gl_Position = vec4((rotate(rotation, point * axes) + translation) * vec3(1, aspect, 1), 1);\n\
 }";
 
-const char *fragmentSource = "#version 410 core\n\
-uniform vec3 light;\n\
+const char *fragmentSource = "#version 410 core\n" GLOBALS_BLOCK "\
 in vec3 n;\n\
 out vec3 fragColor;\n\
 void main()\n\
@@ -35,6 +67,20 @@ void main()\n\
   fragColor = vec3(1, 1, 1) * (ambient + diffuse);\n\
 }";
 
+const char *vertexPoints = "#version 410 core\n" GLOBALS_BLOCK "\
+in vec3 translation;\n\
+void main()\n\
+{\n\
+  gl_Position = vec4(translation * vec3(1, aspect, 1), 1);\n\
+}";
+
+const char *fragmentPoints = "#version 410 core\n\
+out vec3 fragColor;\n\
+void main()\n\
+{\n\
+  fragColor = vec3(0.65, 0.65, 0.65);\n\
+}";
+
 // Vertex array data
 GLfloat vertices[] = {
   // Front face
@@ -83,32 +129,148 @@ unsigned int indices[] = {
   20, 21, 22, 23
 };
 
-void handleCompileError(const char *step, GLuint shader)
+void setupSystem(chrono::ChSystem &sys, bool sleeping)
 {
-  GLint result = GL_FALSE;
-  glGetShaderiv(shader, GL_COMPILE_STATUS, &result);
-  if (result == GL_FALSE) {
-    char buffer[1024];
-    glGetShaderInfoLog(shader, 1024, NULL, buffer);
-    if (buffer[0])
-      fprintf(stderr, "%s: %s\n", step, buffer);
-  };
+  sys.SetSleepingAllowed(sleeping);
+  sys.SetCollisionSystemType(chrono::ChCollisionSystem::Type::BULLET);
+  sys.SetTimestepperType(chrono::ChTimestepper::Type::EULER_IMPLICIT_PROJECTED);
+  sys.SetSolverType(chrono::ChSolver::Type::PSOR);
+  configureIterativeSolver(sys, 100, solver_tolerance);
+  sys.SetGravitationalAcceleration(chrono::ChVector3(0.0, -0.4, 0.0));
 }
 
-void handleLinkError(const char *step, GLuint program)
+std::shared_ptr<chrono::ChContactMaterial> createMaterial(chrono::ChContactMethod method)
 {
-  GLint result = GL_FALSE;
-  glGetProgramiv(program, GL_LINK_STATUS, &result);
-  if (result == GL_FALSE) {
-    char buffer[1024];
-    glGetProgramInfoLog(program, 1024, NULL, buffer);
-    if (buffer[0])
-      fprintf(stderr, "%s: %s\n", step, buffer);
-  };
+  auto material = createContactMaterial(method);
+  material->SetStaticFriction(0.9f);
+  material->SetSlidingFriction(0.5f);
+  material->SetRestitution(0.3f);
+  return material;
+}
+
+// The contact material matches the contact method of the system
+void addStack(chrono::ChSystem &sys, int count, const std::vector<ShapeMargins> &margins)
+{
+  // https://math.stackexchange.com/questions/4501028/calculating-moment-of-inertia-for-a-cuboid
+
+  auto material = createMaterial(sys.GetContactMethod());
+
+  // Stacks of three boxes are repeated on a grid of up to 8 x 8 tiles and then in layers
+  int tiles = (count + 2) / 3;
+  int nx = tiles < 8 ? tiles : 8;
+  int nz = (tiles + 7) / 8 < 8 ? (tiles + 7) / 8 : 8;
+  for (int i=0; i<count; i++) {
+    int j = i % 3;
+    int tile = i / 3;
+    int tx = tile % 8;
+    int tz = (tile / 8) % 8;
+    int layer = tile / 64;
+    auto body = chrono_types::make_shared<chrono::ChBody>();
+    float mass = 10.0;
+    body->SetMass(mass);
+    body->SetInertiaXX(chrono::ChVector3(mass * (b * b + c * c) / 12.0,
+                                         mass * (a * a + c * c) / 12.0,
+                                         mass * (a * a + b * b) / 12.0));
+    body->SetPos(chrono::ChVector3(tx * 2.5 + j * 0.4, 0.2 + j * 0.2 + layer * 0.6, tz * 2.0 - j * 0.3));
+    body->SetSleepingAllowed(true);
+    body->SetSleepTime(sleep_time);
+    body->SetSleepMinLinVel(sleep_lin_vel);
+    body->SetSleepMinAngVel(sleep_ang_vel);
+    sys.AddBody(body);
+
+    auto coll_model = chrono_types::make_shared<chrono::ChCollisionModel>();
+    coll_model->SetSafeMargin(margins[0].margin);
+    coll_model->SetEnvelope(margins[0].envelope);
+    auto shape = chrono_types::make_shared<chrono::ChCollisionShapeBox>(material, a, b, c);
+    coll_model->AddShape(shape);
+    body->AddCollisionModel(coll_model);
+    body->EnableCollision(true);
+  }
+
+  auto ground = chrono_types::make_shared<chrono::ChBody>();
+  ground->SetFixed(true);
+  ground->SetMass(1e+6);
+  ground->SetInertiaXX(chrono::ChVector3(1e+5, 1e+5, 1e+5));
+  ground->SetPos(chrono::ChVector3(1.25 * (nx - 1), -0.5, 1.0 * (nz - 1)));
+  sys.AddBody(ground);
+
+  auto coll_model = chrono_types::make_shared<chrono::ChCollisionModel>();
+  coll_model->SetSafeMargin(margins[1].margin);
+  coll_model->SetEnvelope(margins[1].envelope);
+  auto shape = chrono_types::make_shared<chrono::ChCollisionShapeBox>(material, 2.0 + 2.5 * (nx - 1), 0.2, 2.0 + 2.0 * (nz - 1));
+  coll_model->AddShape(shape);
+  ground->AddCollisionModel(coll_model);
+  ground->EnableCollision(true);
+}
+
+// Wake up a random box and throw it upwards
+void kick(chrono::ChSystem &sys)
+{
+  std::vector<std::shared_ptr<chrono::ChBody>> boxes;
+  for (auto body=sys.GetBodies().begin(); body!=sys.GetBodies().end(); body++)
+    if (!(*body)->IsFixed())
+      boxes.push_back(*body);
+  if (boxes.empty())
+    return;
+  auto box = boxes[rand() % boxes.size()];
+  box->SetSleeping(false);
+  box->SetPosDt(box->GetPosDt() + chrono::ChVector3d(0.0, 1.0, 0.0));
+  box->SetAngVelLocal(chrono::ChVector3d(2.0, 0.0, 1.0));
+}
+
+Scene createStackScene(chrono::ChContactMethod method, chrono::ChCollisionSystem::Type collision, int count,
+                       const std::vector<ShapeMargins> &margins)
+{
+  auto sys = createContactSystem(method);
+  setupSystem(*sys, true);
+  sys->SetCollisionSystemType(collision);
+  addStack(*sys, count, margins);
+  return Scene{sys};
 }
 
-int main(void)
+Scene createMarginScene(const std::vector<ShapeMargins> &margins)
 {
+  return createStackScene(chrono::ChContactMethod::NSC, chrono::ChCollisionSystem::Type::BULLET, scaling_count, margins);
+}
+
+Scene createBackendScene(chrono::ChContactMethod method)
+{
+  std::vector<ShapeMargins> margins = default_margins;
+  loadMargins("stack", margins);
+  return createStackScene(method, chrono::ChCollisionSystem::Type::BULLET, scaling_count, margins);
+}
+
+Scene createCollisionScene(chrono::ChCollisionSystem::Type collision, int count)
+{
+  std::vector<ShapeMargins> margins = default_margins;
+  loadMargins("stack", margins);
+  return createStackScene(chrono::ChContactMethod::NSC, collision, count, margins);
+}
+
+Scene createScene(void)
+{
+  return createBackendScene(chrono::ChContactMethod::NSC);
+}
+
+int main(int argc, char *argv[])
+{
+  if (scalingOption(argc, argv, "stack", createScene, 0.01, 500))
+    return 0;
+  if (autotuneOption(argc, argv, "stack", createScene, 0.01, 200, solver_tolerance))
+    return 0;
+  if (tuneMarginsOption(argc, argv, "stack", createMarginScene, default_margins, 0.01, 500))
+    return 0;
+  if (backendOption(argc, argv, "stack", createBackendScene, 4.0))
+    return 0;
+  if (collisionOption(argc, argv, "stack", createCollisionScene, 24, 3072, 0.01, 200))
+    return 0;
+
+  int count = argc > 1 && argv[1][0] != '-' ? atoi(argv[1]) : 3;
+  if (count < 1) {
+    fprintf(stderr, "Usage: %s [number of boxes (at least 1)] [options]\n", argv[0]);
+    return 1;
+  };
+
   glfwInit();
   GLFWwindow *window = glfwCreateWindow(width, height, "Falling stack of boxes with Project Chrono", NULL, NULL);
   glfwMakeContextCurrent(window);
@@ -117,21 +279,7 @@ int main(void)
   glClearColor(0.1f, 0.1f, 0.1f, 0.0f);
   glViewport(0, 0, width, height);
 
-  GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
-  glShaderSource(vertexShader, 1, &vertexSource, NULL);
-  glCompileShader(vertexShader);
-  handleCompileError("Vertex shader", vertexShader);
-
-  GLuint fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-  glShaderSource(fragmentShader, 1, &fragmentSource, NULL);
-  glCompileShader(fragmentShader);
-  handleCompileError("Fragment shader", fragmentShader);
-
-  GLuint program = glCreateProgram();
-  glAttachShader(program, vertexShader);
-  glAttachShader(program, fragmentShader);
-  glLinkProgram(program);
-  handleLinkError("Shader program", program);
+  Program program = createProgram(vertexSource, fragmentSource);
 
   GLuint vao;
   GLuint vbo;
@@ -147,113 +295,98 @@ int main(void)
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, idx);
   glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
 
-  glUseProgram(program);
+  glUseProgram(program.program);
 
-  glVertexAttribPointer(glGetAttribLocation(program, "point"),
+  glVertexAttribPointer(glGetAttribLocation(program.program, "point"),
                         3, GL_FLOAT, GL_FALSE,
                         6 * sizeof(float), (void *)0);
-  glVertexAttribPointer(glGetAttribLocation(program, "normal"),
+  glVertexAttribPointer(glGetAttribLocation(program.program, "normal"),
                         3, GL_FLOAT, GL_FALSE,
                         6 * sizeof(float), (void *)(3 * sizeof(float)));
 
-  glEnableVertexAttribArray(0);
-  glEnableVertexAttribArray(1);
+  glEnableVertexAttribArray(glGetAttribLocation(program.program, "point"));
+  glEnableVertexAttribArray(glGetAttribLocation(program.program, "normal"));
+
+  GLint translation = glGetAttribLocation(program.program, "translation");
+  GLint rotation = glGetAttribLocation(program.program, "rotation");
+
+  // Far bodies are drawn as points
+  Program program_points = createProgram(vertexPoints, fragmentPoints);
+  GLuint vao_points;
+  glGenVertexArrays(1, &vao_points);
+  GLint translation_points = glGetAttribLocation(program_points.program, "translation");
 
   glDisable(GL_CULL_FACE);
   glEnable(GL_DEPTH_TEST);
+  glPointSize(3.0f);
 
   float light[3] = {0.36f, 0.8f, -0.48f};
-  glUniform3fv(glGetUniformLocation(program, "light"), 1, light);
-  glUniform1f(glGetUniformLocation(program, "aspect"), (float)width / (float)height);
-  float a = 1.0;
-  float b = 0.1;
-  float c = 0.5;
+  GLuint globals = createGlobals();
+  attachGlobals(program);
+  attachGlobals(program_points);
+  updateGlobals(globals, (float)width / (float)height, light);
   float axes[3] = {a, b, c};
-  glUniform3fv(glGetUniformLocation(program, "axes"), 1, axes);
-
-  chrono::ChSystemNSC sys;
-  sys.SetCollisionSystemType(chrono::ChCollisionSystem::Type::BULLET);
-  sys.SetTimestepperType(chrono::ChTimestepper::Type::EULER_IMPLICIT_PROJECTED);
-  sys.SetSolverType(chrono::ChSolver::Type::PSOR);
-  sys.GetSolver()->AsIterative()->SetMaxIterations(100);
-  sys.SetGravitationalAcceleration(chrono::ChVector3(0.0, -0.4, 0.0));
-
-  // https://math.stackexchange.com/questions/4501028/calculating-moment-of-inertia-for-a-cuboid
-
-  auto material = chrono_types::make_shared<chrono::ChContactMaterialNSC>();
-  material->SetStaticFriction(0.9f);
-  material->SetSlidingFriction(0.5f);
-  material->SetRestitution(0.3f);
-
-  for (int i=0; i<3; i++) {
-    auto body = chrono_types::make_shared<chrono::ChBody>();
-    float mass = 10.0;
-    body->SetMass(mass);
-    body->SetInertiaXX(chrono::ChVector3(mass * (b * b + c * c) / 12.0,
-                                         mass * (a * a + c * c) / 12.0,
-                                         mass * (a * a + b * b) / 12.0));
-    body->SetPos(chrono::ChVector3(i * 0.4, 0.2 + i * 0.2, -i * 0.3));
-    sys.AddBody(body);
-
-    auto coll_model = chrono_types::make_shared<chrono::ChCollisionModel>();
-    coll_model->SetSafeMargin(0.1f);
-    coll_model->SetEnvelope(0.001f);
-    auto shape = chrono_types::make_shared<chrono::ChCollisionShapeBox>(material, a, b, c);
-    coll_model->AddShape(shape);
-    body->AddCollisionModel(coll_model);
-    body->EnableCollision(true);
-  }
-
-  auto ground = chrono_types::make_shared<chrono::ChBody>();
-  ground->SetFixed(true);
-  ground->SetMass(1e+6);
-  ground->SetInertiaXX(chrono::ChVector3(1e+5, 1e+5, 1e+5));
-  ground->SetPos(chrono::ChVector3(0.0, -0.5, 0.0));
-  sys.AddBody(ground);
-
-  auto coll_model = chrono_types::make_shared<chrono::ChCollisionModel>();
-  coll_model->SetSafeMargin(0.1f);
-  coll_model->SetEnvelope(0.001f);
-  auto shape = chrono_types::make_shared<chrono::ChCollisionShapeBox>(material, 2.0, 0.2, 2.0);
-  coll_model->AddShape(shape);
-  ground->AddCollisionModel(coll_model);
-  ground->EnableCollision(true);
-
+  glUniform3fv(program.axes, 1, axes);
+
+  std::shared_ptr<chrono::ChSystem> system = createContactSystem(contactMethodOption(argc, argv));
+  chrono::ChSystem &sys = *system;
+  bool sleeping = true;
+  for (int i=1; i<argc; i++)
+    if (!strcmp(argv[i], "--no-sleep"))
+      sleeping = false;
+  setupSystem(sys, sleeping);
+  sys.SetCollisionSystemType(collisionSystemOption(argc, argv));
+  useProfile("stack", sys, solver_tolerance);
+  std::vector<ShapeMargins> margins = default_margins;
+  if (loadMargins("stack", margins))
+    printf("stack.margins: box %g/%g, ground %g/%g\n", margins[0].margin, margins[0].envelope,
+           margins[1].margin, margins[1].envelope);
+  addStack(sys, count, margins);
+  SolverLog solver_log(argc, argv);
+  ContactLog contact_log(argc, argv);
+
+  PoseBuffer *poses = new PoseBuffer(count);
+  PoseBuffer *poses_points = new PoseBuffer(count);
+  Culling culling((float)width / (float)height, 0.5f);
+  double bounding_radius = 0.5 * sqrt(a * a + b * b + c * c);
+
+  bool space_pressed = false;
   double t = glfwGetTime();
   while (!glfwWindowShouldClose(window)) {
     double dt = glfwGetTime() - t;
 
     glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
 
-    for (auto body=sys.GetBodies().begin(); body!=sys.GetBodies().end(); body++) {
-      if ((*body)->IsFixed()) continue;
-      chrono::ChQuaternion quat = (*body)->GetRot();
-      chrono::ChMatrix33 mat(quat);
-      chrono::ChVector3 x = mat.GetAxisX();
-      chrono::ChVector3 y = mat.GetAxisY();
-      chrono::ChVector3 z = mat.GetAxisZ();
+    culling.update(sys.GetBodies(), bounding_radius, *poses, *poses_points);
 
-      float rotation[9] = {
-        (float)x.x(), (float)y.x(), (float)z.x(),
-        (float)x.y(), (float)y.y(), (float)z.y(),
-        (float)x.z(), (float)y.z(), (float)z.z()
-      };
+    glUseProgram(program.program);
+    glBindVertexArray(vao);
+    poses->bindAttributes(translation, rotation);
+    glDrawElementsInstanced(GL_QUADS, 24, GL_UNSIGNED_INT, (void *)0, culling.num_detail);
+    poses->fence();
 
-      glUniformMatrix3fv(glGetUniformLocation(program, "rotation"), 1, GL_TRUE, rotation);
-
-      chrono::ChVector3 position = (*body)->GetPos();
-      float translation[3] = {(float)position.x(), (float)position.y(), (float)position.z()};
-      glUniform3fv(glGetUniformLocation(program, "translation"), 1, translation);
-
-      glDrawElements(GL_QUADS, 24, GL_UNSIGNED_INT, (void *)0);
-    };
+    glUseProgram(program_points.program);
+    glBindVertexArray(vao_points);
+    poses_points->bindAttributes(translation_points, -1);
+    glDrawArraysInstanced(GL_POINTS, 0, 1, culling.num_points);
+    poses_points->fence();
 
     glfwSwapBuffers(window);
     glfwPollEvents();
+    bool space = glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS;
+    if (space && !space_pressed)
+      kick(sys);
+    space_pressed = space;
     sys.DoStepDynamics(dt);
+    solver_log.update(sys);
+    contact_log.update(sys);
     t += dt;
   };
 
+  delete poses_points;
+  delete poses;
+  glDeleteVertexArrays(1, &vao_points);
+
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
   glDeleteBuffers(1, &idx);
   glBindBuffer(GL_ARRAY_BUFFER, 0);
@@ -261,9 +394,9 @@ int main(void)
   glBindVertexArray(0);
   glDeleteVertexArrays(1, &vao);
 
-  glDeleteProgram(program);
-  glDeleteShader(vertexShader);
-  glDeleteShader(fragmentShader);
+  deleteGlobals(globals);
+  deleteProgram(program_points);
+  deleteProgram(program);
 
   glfwTerminate();
   return 0;
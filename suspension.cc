@@ -1,19 +1,36 @@
 #include <cmath>
 #include <cstdio>
+#include <cstring>
 #include <vector>
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #include <chrono/core/ChQuaternion.h>
+#include <chrono/core/ChTimer.h>
 #include <chrono/physics/ChBody.h>
 #include <chrono/physics/ChLinkTSDA.h>
 #include <chrono/physics/ChLinkLock.h>
 #include <chrono/physics/ChSystemNSC.h>
+#include <chrono/physics/ChSystemSMC.h>
+#include <chrono/solver/ChDirectSolverLS.h>
+#include <chrono/timestepper/ChTimestepperHHT.h>
+#include "renderer.hh"
+#include "scaling.hh"
+#include "autotune.hh"
+#include "solverlog.hh"
+#include "backend.hh"
+#include "telemetry.hh"
 
 int width = 1280;
 int height = 720;
 
-const char *vertexSource = "#version 410 core\n\
-uniform float aspect;\n\
+const float a = 0.1;
+const float b = 0.1;
+const float c = 0.1;
+
+// Tolerance of the warm started PSOR solver of the non-stiff mode
+const double solver_tolerance = 1e-4;
+
+const char *vertexSource = "#version 410 core\n" GLOBALS_BLOCK "\
 uniform vec3 axes;\n\
 uniform vec3 translation;\n\
 uniform mat3 rotation;\n\
@@ -26,8 +43,7 @@ void main()\n\
   gl_Position = vec4((rotation * (point * axes) + translation) * vec3(1, aspect, 1), 1);\n\
 }";
 
-const char *fragmentSource = "#version 410 core\n\
-uniform vec3 light;\n\
+const char *fragmentSource = "#version 410 core\n" GLOBALS_BLOCK "\
 in vec3 n;\n\
 out vec3 fragColor;\n\
 void main()\n\
@@ -85,107 +101,58 @@ unsigned int indices[] = {
   20, 21, 22, 23
 };
 
-void handleCompileError(const char *step, GLuint shader)
+// The default setup uses complementarity contacts with projected implicit Euler and PSOR.
+// The stiff setup uses penalty contacts with HHT, whose Newton iteration solves the full system with a sparse direct solver.
+std::shared_ptr<chrono::ChSystem> createSystem(bool stiff)
 {
-  GLint result = GL_FALSE;
-  glGetShaderiv(shader, GL_COMPILE_STATUS, &result);
-  if (result == GL_FALSE) {
-    char buffer[1024];
-    glGetShaderInfoLog(shader, 1024, NULL, buffer);
-    if (buffer[0])
-      fprintf(stderr, "%s: %s\n", step, buffer);
+  std::shared_ptr<chrono::ChSystem> sys;
+  if (stiff) {
+    sys = chrono_types::make_shared<chrono::ChSystemSMC>();
+    auto solver = chrono_types::make_shared<chrono::ChSolverSparseLU>();
+    solver->UseSparsityPatternLearner(true);
+    solver->LockSparsityPattern(false);
+    sys->SetSolver(solver);
+    sys->SetTimestepperType(chrono::ChTimestepper::Type::HHT);
+    auto hht = std::static_pointer_cast<chrono::ChTimestepperHHT>(sys->GetTimestepper());
+    hht->SetAlpha(-0.2);
+    hht->SetMaxIters(20);
+    hht->SetAbsTolerances(1e-6);
+    hht->SetStepControl(false);
+    hht->SetModifiedNewton(false);
+  } else {
+    sys = chrono_types::make_shared<chrono::ChSystemNSC>();
+    sys->SetTimestepperType(chrono::ChTimestepper::Type::EULER_IMPLICIT_PROJECTED);
+    sys->SetSolverType(chrono::ChSolver::Type::PSOR);
+    configureIterativeSolver(*sys, 100, solver_tolerance);
   };
+  sys->SetCollisionSystemType(chrono::ChCollisionSystem::Type::BULLET);
+  sys->SetGravitationalAcceleration(chrono::ChVector3(0.0, -0.4, 0.0));
+  return sys;
 }
 
-void handleLinkError(const char *step, GLuint program)
+std::shared_ptr<chrono::ChContactMaterial> createMaterial(chrono::ChContactMethod method)
 {
-  GLint result = GL_FALSE;
-  glGetProgramiv(program, GL_LINK_STATUS, &result);
-  if (result == GL_FALSE) {
-    char buffer[1024];
-    glGetProgramInfoLog(program, 1024, NULL, buffer);
-    if (buffer[0])
-      fprintf(stderr, "%s: %s\n", step, buffer);
-  };
+  auto material = createContactMaterial(method);
+  material->SetStaticFriction(0.9f);
+  material->SetSlidingFriction(0.5f);
+  material->SetRestitution(0.3f);
+  return material;
 }
 
-int main(void)
-{
-  glfwInit();
-  GLFWwindow *window = glfwCreateWindow(width, height, "Spring-damper system with Project Chrono", NULL, NULL);
-  glfwMakeContextCurrent(window);
-  glewInit();
-
-  glClearColor(0.1f, 0.1f, 0.1f, 0.0f);
-  glViewport(0, 0, width, height);
-
-  GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
-  glShaderSource(vertexShader, 1, &vertexSource, NULL);
-  glCompileShader(vertexShader);
-  handleCompileError("Vertex shader", vertexShader);
-
-  GLuint fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-  glShaderSource(fragmentShader, 1, &fragmentSource, NULL);
-  glCompileShader(fragmentShader);
-  handleCompileError("Fragment shader", fragmentShader);
-
-  GLuint program = glCreateProgram();
-  glAttachShader(program, vertexShader);
-  glAttachShader(program, fragmentShader);
-  glLinkProgram(program);
-  handleLinkError("Shader program", program);
-
-  GLuint vao;
-  GLuint vbo;
-  GLuint idx;
-
-  glGenVertexArrays(1, &vao);
-  glBindVertexArray(vao);
-
-  glGenBuffers(1, &vbo);
-  glBindBuffer(GL_ARRAY_BUFFER, vbo);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-  glGenBuffers(1, &idx);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, idx);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
-
-  glUseProgram(program);
-
-  glVertexAttribPointer(glGetAttribLocation(program, "point"),
-                        3, GL_FLOAT, GL_FALSE,
-                        6 * sizeof(float), (void *)0);
-  glVertexAttribPointer(glGetAttribLocation(program, "normal"),
-                        3, GL_FLOAT, GL_FALSE,
-                        6 * sizeof(float), (void *)(3 * sizeof(float)));
-
-  glEnableVertexAttribArray(0);
-  glEnableVertexAttribArray(1);
-
-  glDisable(GL_CULL_FACE);
-  glEnable(GL_DEPTH_TEST);
-
-  float light[3] = {0.36f, 0.8f, -0.48f};
-  glUniform3fv(glGetUniformLocation(program, "light"), 1, light);
-  glUniform1f(glGetUniformLocation(program, "aspect"), (float)width / (float)height);
-  float a = 0.1;
-  float b = 0.1;
-  float c = 0.1;
-  float axes[3] = {a, b, c};
-  glUniform3fv(glGetUniformLocation(program, "axes"), 1, axes);
+struct Suspension {
+  std::shared_ptr<chrono::ChBody> upper;
+  std::shared_ptr<chrono::ChBody> lower;
+  std::shared_ptr<chrono::ChLinkTSDA> spring;
+};
 
-  chrono::ChSystemNSC sys;
-  sys.SetCollisionSystemType(chrono::ChCollisionSystem::Type::BULLET);
-  sys.SetTimestepperType(chrono::ChTimestepper::Type::EULER_IMPLICIT_PROJECTED);
-  sys.SetSolverType(chrono::ChSolver::Type::PSOR);
-  sys.GetSolver()->AsIterative()->SetMaxIterations(100);
-  sys.SetGravitationalAcceleration(chrono::ChVector3(0.0, -0.4, 0.0));
+// Heavy upper mass connected to a lower mass by a spring-damper and a prismatic joint. The lower mass collides with the ground.
+Suspension addSuspension(chrono::ChSystem &sys, bool stiff)
+{
+  Suspension suspension;
 
   // https://math.stackexchange.com/questions/4501028/calculating-moment-of-inertia-for-a-cuboid
 
-  auto material = chrono_types::make_shared<chrono::ChContactMaterialNSC>();
-  material->SetStaticFriction(0.9f);
-  material->SetSlidingFriction(0.5f);
-  material->SetRestitution(0.3f);
+  auto material = createMaterial(sys.GetContactMethod());
 
   float upper_mass = 1000.0;
   float mass = 10.0;
@@ -197,6 +164,7 @@ int main(void)
                                         upper_mass * (a * a + b * b) / 12.0));
   upper->SetPos(chrono::ChVector3(0.0, 0.6, 0.0));
   sys.AddBody(upper);
+  suspension.upper = upper;
 
   auto lower = chrono_types::make_shared<chrono::ChBody>();
   lower->SetMass(mass);
@@ -205,6 +173,7 @@ int main(void)
                                         mass * (a * a + b * b) / 12.0));
   lower->SetPos(chrono::ChVector3(0.0, 0.3, 0.0));
   sys.AddBody(lower);
+  suspension.lower = lower;
 
   auto coll_model = chrono_types::make_shared<chrono::ChCollisionModel>();
   coll_model->SetSafeMargin(0.1f);
@@ -218,7 +187,10 @@ int main(void)
   link->Initialize(upper, lower, false, upper->GetPos(), lower->GetPos());
   link->SetSpringCoefficient(10000.0f);
   link->SetDampingCoefficient(1000.0f);
+  // Include the spring and damper Jacobians in the system matrix (not supported by PSOR)
+  link->IsStiff(stiff);
   sys.AddLink(link);
+  suspension.spring = link;
 
   auto prismatic = chrono_types::make_shared<chrono::ChLinkLockPrismatic>();
   prismatic->Initialize(upper, lower, chrono::ChFrame<>(upper->GetPos(), chrono::QuatFromAngleX(-chrono::CH_PI_2)));
@@ -238,6 +210,128 @@ int main(void)
   coll_model_ground->AddShape(shape_ground);
   ground->AddCollisionModel(coll_model_ground);
   ground->EnableCollision(true);
+  return suspension;
+}
+
+Scene createScene(void)
+{
+  auto sys = createSystem(false);
+  addSuspension(*sys, false);
+  return Scene{sys};
+}
+
+// Simulate a few seconds with increasing step sizes using the default and the stiff setup.
+// A run is considered unstable if the state becomes invalid, the masses move faster than 10 m/s, or the lower mass
+// leaves the region above the ground.
+int stability(void)
+{
+  double steps[] = {0.001, 0.002, 0.005, 0.01, 0.02, 0.05, 0.1, 0.2};
+  double duration = 5.0;
+  printf("mode    dt     ms/step stable upper_y lower_y\n");
+  for (int mode=0; mode<2; mode++) {
+    double largest = 0.0;
+    bool all_stable = true;
+    for (int i=0; i<8; i++) {
+      double dt = steps[i];
+      auto sys = createSystem(mode == 1);
+      Suspension suspension = addSuspension(*sys, mode == 1);
+      int n = (int)round(duration / dt);
+      bool stable = true;
+      // An unstable run stops early, so the time is divided by the steps actually taken
+      int taken = 0;
+      chrono::ChTimer timer;
+      timer.start();
+      for (int k=0; k<n && stable; k++) {
+        sys->DoStepDynamics(dt);
+        taken++;
+        double upper_y = suspension.upper->GetPos().y();
+        double lower_y = suspension.lower->GetPos().y();
+        stable = std::isfinite(upper_y) && std::isfinite(lower_y) &&
+                 suspension.upper->GetPosDt().Length() < 10.0 && suspension.lower->GetPosDt().Length() < 10.0 &&
+                 lower_y > -0.5 && lower_y < 1.0;
+      };
+      timer.stop();
+      all_stable = all_stable && stable;
+      if (all_stable)
+        largest = dt;
+      printf("%-7s %-6g %7.3f %-6s %7.3f %7.3f\n", mode == 1 ? "stiff" : "default", dt, 1000.0 * timer.GetTimeSeconds() / taken,
+             stable ? "yes" : "no", suspension.upper->GetPos().y(), suspension.lower->GetPos().y());
+      fflush(stdout);
+    };
+    printf("# largest stable step for %s setup: %g\n", mode == 1 ? "stiff" : "default", largest);
+  };
+  return 0;
+}
+
+int main(int argc, char *argv[])
+{
+  if (scalingOption(argc, argv, "suspension", createScene, 0.01, 1000))
+    return 0;
+  if (autotuneOption(argc, argv, "suspension", createScene, 0.01, 200, solver_tolerance))
+    return 0;
+  if (argc > 1 && !strcmp(argv[1], "--stability"))
+    return stability();
+  bool stiff = argc > 1 && !strcmp(argv[1], "--stiff");
+
+  glfwInit();
+  GLFWwindow *window = glfwCreateWindow(width, height, "Spring-damper system with Project Chrono", NULL, NULL);
+  glfwMakeContextCurrent(window);
+  glewInit();
+
+  glClearColor(0.1f, 0.1f, 0.1f, 0.0f);
+  glViewport(0, 0, width, height);
+
+  Program program = createProgram(vertexSource, fragmentSource);
+
+  GLuint vao;
+  GLuint vbo;
+  GLuint idx;
+
+  glGenVertexArrays(1, &vao);
+  glBindVertexArray(vao);
+
+  glGenBuffers(1, &vbo);
+  glBindBuffer(GL_ARRAY_BUFFER, vbo);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+  glGenBuffers(1, &idx);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, idx);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+
+  glUseProgram(program.program);
+
+  glVertexAttribPointer(glGetAttribLocation(program.program, "point"),
+                        3, GL_FLOAT, GL_FALSE,
+                        6 * sizeof(float), (void *)0);
+  glVertexAttribPointer(glGetAttribLocation(program.program, "normal"),
+                        3, GL_FLOAT, GL_FALSE,
+                        6 * sizeof(float), (void *)(3 * sizeof(float)));
+
+  glEnableVertexAttribArray(0);
+  glEnableVertexAttribArray(1);
+
+  glDisable(GL_CULL_FACE);
+  glEnable(GL_DEPTH_TEST);
+
+  float light[3] = {0.36f, 0.8f, -0.48f};
+  GLuint globals = createGlobals();
+  attachGlobals(program);
+  updateGlobals(globals, (float)width / (float)height, light);
+  float axes[3] = {a, b, c};
+  glUniform3fv(program.axes, 1, axes);
+
+  auto sys = createSystem(stiff);
+  sys->SetCollisionSystemType(collisionSystemOption(argc, argv));
+  if (!stiff)
+    useProfile("suspension", *sys, solver_tolerance);
+  Suspension suspension = addSuspension(*sys, stiff);
+  SolverLog solver_log(argc, argv);
+  TelemetryPublisher *telemetry = telemetryOption(argc, argv, "suspension");
+  int channel_upper = telemetry ? telemetry->add("upper_y") : -1;
+  int channel_lower = telemetry ? telemetry->add("lower_y") : -1;
+  int channel_length = telemetry ? telemetry->add("spring_length") : -1;
+  int channel_force = telemetry ? telemetry->add("spring_force") : -1;
+
+  DrawList draws;
 
   double t = glfwGetTime();
   while (!glfwWindowShouldClose(window)) {
@@ -245,32 +339,24 @@ int main(void)
 
     glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
 
-    for (auto body=sys.GetBodies().begin(); body!=sys.GetBodies().end(); body++) {
+    draws.clear();
+    for (auto body=sys->GetBodies().begin(); body!=sys->GetBodies().end(); body++) {
       if ((*body)->IsFixed()) continue;
-      chrono::ChQuaternion quat = (*body)->GetRot();
-      chrono::ChMatrix33 mat(quat);
-      chrono::ChVector3 x = mat.GetAxisX();
-      chrono::ChVector3 y = mat.GetAxisY();
-      chrono::ChVector3 z = mat.GetAxisZ();
-
-      float rotation[9] = {
-        (float)x.x(), (float)y.x(), (float)z.x(),
-        (float)x.y(), (float)y.y(), (float)z.y(),
-        (float)x.z(), (float)y.z(), (float)z.z()
-      };
-
-      glUniformMatrix3fv(glGetUniformLocation(program, "rotation"), 1, GL_TRUE, rotation);
-
-      chrono::ChVector3 position = (*body)->GetPos();
-      float translation[3] = {(float)position.x(), (float)position.y(), (float)position.z()};
-      glUniform3fv(glGetUniformLocation(program, "translation"), 1, translation);
-
-      glDrawElements(GL_QUADS, 24, GL_UNSIGNED_INT, (void *)0);
+      draws.add(program, vao, GL_QUADS, 24, **body);
     };
+    draws.submit();
 
     glfwSwapBuffers(window);
     glfwPollEvents();
-    sys.DoStepDynamics(dt);
+    sys->DoStepDynamics(dt);
+    solver_log.update(*sys);
+    if (telemetry) {
+      telemetry->set(channel_upper, suspension.upper->GetPos().y());
+      telemetry->set(channel_lower, suspension.lower->GetPos().y());
+      telemetry->set(channel_length, suspension.spring->GetLength());
+      telemetry->set(channel_force, suspension.spring->GetForce());
+      telemetry->publish(sys->GetChTime());
+    };
     t += dt;
   };
 
@@ -281,9 +367,9 @@ int main(void)
   glBindVertexArray(0);
   glDeleteVertexArrays(1, &vao);
 
-  glDeleteProgram(program);
-  glDeleteShader(vertexShader);
-  glDeleteShader(fragmentShader);
+  delete telemetry;
+  deleteGlobals(globals);
+  deleteProgram(program);
 
   glfwTerminate();
   return 0;
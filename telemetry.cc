@@ -0,0 +1,156 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "telemetry.hh"
+
+#define TELEMETRY_MAGIC 0x54656c65
+
+static TelemetrySegment *mapSegment(const char *name, bool create)
+{
+  int fd = shm_open(name, create ? O_CREAT | O_RDWR : O_RDONLY, 0644);
+  if (fd < 0) {
+    // A missing segment is expected while a reader waits for the publisher
+    if (create || errno != ENOENT)
+      perror(name);
+    return NULL;
+  };
+  if (create && ftruncate(fd, sizeof(TelemetrySegment)) < 0) {
+    perror(name);
+    close(fd);
+    return NULL;
+  };
+  // Until the publisher has resized the segment, reading it would raise SIGBUS
+  struct stat status;
+  if (!create && (fstat(fd, &status) < 0 || status.st_size < (off_t)sizeof(TelemetrySegment))) {
+    close(fd);
+    return NULL;
+  };
+  void *address = mmap(NULL, sizeof(TelemetrySegment), create ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (address == MAP_FAILED) {
+    perror(name);
+    return NULL;
+  };
+  return static_cast<TelemetrySegment *>(address);
+}
+
+TelemetryPublisher::TelemetryPublisher(const char *name):
+  name(name), segment(NULL), count(0)
+{
+  memset(values, 0, sizeof(values));
+  segment = mapSegment(name, true);
+  if (!segment)
+    return;
+  new (segment) TelemetrySegment();
+  segment->magic = TELEMETRY_MAGIC;
+}
+
+TelemetryPublisher::~TelemetryPublisher()
+{
+  if (!segment)
+    return;
+  munmap(segment, sizeof(TelemetrySegment));
+  shm_unlink(name.c_str());
+}
+
+int TelemetryPublisher::add(const char *channel)
+{
+  if (!segment || count > 0 || segment->num_channels >= TELEMETRY_MAX_CHANNELS)
+    return -1;
+  int index = segment->num_channels;
+  strncpy(segment->names[index], channel, TELEMETRY_NAME_LENGTH - 1);
+  segment->num_channels = index + 1;
+  return index;
+}
+
+void TelemetryPublisher::publish(double time)
+{
+  if (!segment)
+    return;
+  uint64_t index = count++;
+  TelemetryRecord &record = segment->records[index % TELEMETRY_CAPACITY];
+  record.sequence.store(2 * index + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  record.time = time;
+  memcpy(record.values, values, segment->num_channels * sizeof(double));
+  record.sequence.store(2 * index + 2, std::memory_order_release);
+  segment->head.store(index + 1, std::memory_order_release);
+}
+
+TelemetryReader::TelemetryReader(const char *name):
+  segment(NULL), position(0), lost(0)
+{
+  segment = mapSegment(name, false);
+  if (segment && segment->magic != TELEMETRY_MAGIC) {
+    // The magic number is zero until the publisher has initialised the segment
+    if (segment->magic != 0)
+      fprintf(stderr, "%s: not a telemetry segment\n", name);
+    munmap(segment, sizeof(TelemetrySegment));
+    segment = NULL;
+  };
+}
+
+TelemetryReader::~TelemetryReader()
+{
+  if (segment)
+    munmap(segment, sizeof(TelemetrySegment));
+}
+
+bool TelemetryReader::wait(int timeout_ms)
+{
+  for (int i=0; i<timeout_ms; i+=10) {
+    uint64_t head = segment->head.load(std::memory_order_acquire);
+    if (head > 0) {
+      // Follow the live end of the stream
+      position = head - 1;
+      return true;
+    };
+    usleep(10000);
+  };
+  return false;
+}
+
+bool TelemetryReader::next(double &time, double *values)
+{
+  while (true) {
+    uint64_t head = segment->head.load(std::memory_order_acquire);
+    if (position >= head)
+      return false;
+    if (head - position > TELEMETRY_CAPACITY) {
+      lost += head - TELEMETRY_CAPACITY - position;
+      position = head - TELEMETRY_CAPACITY;
+    };
+    const TelemetryRecord &record = segment->records[position % TELEMETRY_CAPACITY];
+    uint64_t before = record.sequence.load(std::memory_order_acquire);
+    time = record.time;
+    memcpy(values, record.values, segment->num_channels * sizeof(double));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint64_t after = record.sequence.load(std::memory_order_relaxed);
+    bool complete = before == 2 * position + 2 && after == before;
+    if (!complete)
+      lost++;
+    position++;
+    if (complete)
+      return true;
+  };
+}
+
+TelemetryPublisher *telemetryOption(int argc, char *argv[], const char *scene)
+{
+  for (int i=1; i<argc; i++)
+    if (!strcmp(argv[i], "--telemetry")) {
+      std::string name = i + 1 < argc && argv[i + 1][0] == '/' ? argv[i + 1] : std::string("/") + scene;
+      TelemetryPublisher *publisher = new TelemetryPublisher(name.c_str());
+      if (!publisher->valid()) {
+        delete publisher;
+        return NULL;
+      };
+      return publisher;
+    };
+  return NULL;
+}
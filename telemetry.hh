@@ -0,0 +1,69 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#define TELEMETRY_CAPACITY 4096
+#define TELEMETRY_MAX_CHANNELS 32
+#define TELEMETRY_NAME_LENGTH 32
+
+// Sample of all channels. "sequence" is 2 * index + 1 while the record is written and 2 * index + 2 when it is complete.
+struct TelemetryRecord {
+  std::atomic<uint64_t> sequence;
+  double time;
+  double values[TELEMETRY_MAX_CHANNELS];
+};
+
+// Channel names followed by a ring of records. "head" is the number of records published so far.
+struct TelemetrySegment {
+  uint32_t magic;
+  uint32_t num_channels;
+  char names[TELEMETRY_MAX_CHANNELS][TELEMETRY_NAME_LENGTH];
+  alignas(64) std::atomic<uint64_t> head;
+  TelemetryRecord records[TELEMETRY_CAPACITY];
+};
+
+// Writer of named telemetry channels into the POSIX shared memory segment "name" (e.g. "/suspension").
+// Publishing never waits for readers: the oldest records are overwritten and readers detect this using the sequence numbers.
+// The segment is unlinked when the publisher is destroyed.
+class TelemetryPublisher {
+public:
+  TelemetryPublisher(const char *name);
+  ~TelemetryPublisher();
+
+  bool valid(void) const { return segment != NULL; }
+  // Add a channel before the first record is published. Returns the channel index or -1.
+  int add(const char *channel);
+  void set(int channel, double value) { if (channel >= 0) values[channel] = value; }
+  // Append a record with the current channel values
+  void publish(double time);
+
+  std::string name;
+  TelemetrySegment *segment;
+  uint64_t count;
+  double values[TELEMETRY_MAX_CHANNELS];
+};
+
+// Reader following the records of a telemetry segment as they are published
+class TelemetryReader {
+public:
+  TelemetryReader(const char *name);
+  ~TelemetryReader();
+
+  bool valid(void) const { return segment != NULL; }
+  // Wait until the publisher has added its channels and published a record. Returns false on timeout.
+  bool wait(int timeout_ms);
+  int numChannels(void) const { return segment->num_channels; }
+  const char *channelName(int channel) const { return segment->names[channel]; }
+  // Copy the next complete record and return true, or return false if there is no new record.
+  // Records overwritten before they could be read are counted in "lost".
+  bool next(double &time, double *values);
+
+  TelemetrySegment *segment;
+  uint64_t position;
+  uint64_t lost;
+};
+
+// Add the publisher named after the "--telemetry" option (e.g. "--telemetry /name", default "/<scene>")
+// or return NULL if the option is not given
+TelemetryPublisher *telemetryOption(int argc, char *argv[], const char *scene);
@@ -0,0 +1,74 @@
+#include <cmath>
+#include "terrain.hh"
+
+Terrain::Terrain(chrono::ChSystem &sys, std::shared_ptr<chrono::ChContactMaterial> material,
+                 double level, double tile_length, double width, int tiles_behind, int tiles_ahead):
+  sys(sys), material(material), level(level), tile_length(tile_length), width(width), thickness(0.2),
+  tiles_behind(tiles_behind), tiles_ahead(tiles_ahead), margin(0.1f), envelope(0.001f), family(0),
+  profile([](double) { return 0.0; })
+{
+}
+
+Terrain::~Terrain()
+{
+  for (auto tile=tiles.begin(); tile!=tiles.end(); tile++)
+    sys.RemoveBody(tile->second);
+}
+
+double Terrain::height(double world_x) const
+{
+  return level + profile(world_x);
+}
+
+std::shared_ptr<chrono::ChBody> Terrain::createTile(const FloatingOrigin &origin, long index)
+{
+  double x0 = index * tile_length;
+  double x1 = x0 + tile_length;
+  double h0 = height(x0);
+  double h1 = height(x1);
+  double angle = atan2(h1 - h0, tile_length);
+  double length = sqrt(tile_length * tile_length + (h1 - h0) * (h1 - h0));
+  // Center of the slab is half its thickness below the middle of the top surface
+  chrono::ChVector3d normal(-sin(angle), cos(angle), 0.0);
+  chrono::ChVector3d top(0.5 * (x0 + x1) - origin.origin.x(), 0.5 * (h0 + h1) - origin.origin.y(), -origin.origin.z());
+
+  auto tile = chrono_types::make_shared<chrono::ChBody>();
+  tile->SetFixed(true);
+  tile->SetMass(1e+6);
+  tile->SetInertiaXX(chrono::ChVector3(1e+5, 1e+5, 1e+5));
+  tile->SetPos(top - normal * (0.5 * thickness));
+  tile->SetRot(chrono::QuatFromAngleZ(angle));
+
+  auto coll_model = chrono_types::make_shared<chrono::ChCollisionModel>();
+  coll_model->SetSafeMargin(margin);
+  coll_model->SetEnvelope(envelope);
+  // Neighbouring tiles overlap slightly so that wheels do not catch on internal edges
+  auto shape = chrono_types::make_shared<chrono::ChCollisionShapeBox>(material, length + 0.05 * tile_length, thickness, width);
+  coll_model->AddShape(shape);
+  coll_model->SetFamily(family);
+  tile->AddCollisionModel(coll_model);
+  tile->EnableCollision(true);
+  return tile;
+}
+
+void Terrain::update(const FloatingOrigin &origin, double x)
+{
+  long center = (long)floor((x + origin.origin.x()) / tile_length);
+  long first = center - tiles_behind;
+  long last = center + tiles_ahead;
+
+  for (auto tile=tiles.begin(); tile!=tiles.end();) {
+    if (tile->first < first || tile->first > last) {
+      sys.RemoveBody(tile->second);
+      tile = tiles.erase(tile);
+    } else
+      tile++;
+  };
+
+  for (long index=first; index<=last; index++)
+    if (tiles.find(index) == tiles.end()) {
+      auto tile = createTile(origin, index);
+      sys.AddBody(tile);
+      tiles[index] = tile;
+    };
+}
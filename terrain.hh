@@ -0,0 +1,38 @@
+#pragma once
+#include <functional>
+#include <map>
+#include <memory>
+#include <chrono/physics/ChBody.h>
+#include <chrono/physics/ChSystem.h>
+#include "origin.hh"
+
+// Road made of fixed box tiles which are streamed in ahead of and removed behind a moving body.
+// Each tile is a slab whose top surface linearly connects the road profile at both ends of the tile,
+// so the tiles form a piecewise linear height field. The profile is a function of the world x coordinate.
+class Terrain {
+public:
+  Terrain(chrono::ChSystem &sys, std::shared_ptr<chrono::ChContactMaterial> material,
+          double level, double tile_length, double width, int tiles_behind, int tiles_ahead);
+  ~Terrain();
+
+  // Add and remove tiles around the local x coordinate of the tracked body
+  void update(const FloatingOrigin &origin, double x);
+  double height(double world_x) const;
+
+  chrono::ChSystem &sys;
+  std::shared_ptr<chrono::ChContactMaterial> material;
+  double level;
+  double tile_length;
+  double width;
+  double thickness;
+  int tiles_behind;
+  int tiles_ahead;
+  float margin;
+  float envelope;
+  int family;
+  std::function<double(double)> profile;
+  std::map<long, std::shared_ptr<chrono::ChBody>> tiles;
+
+protected:
+  std::shared_ptr<chrono::ChBody> createTile(const FloatingOrigin &origin, long index);
+};
@@ -1,16 +1,24 @@
 #include <cmath>
 #include <cstdio>
+#include <memory>
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #include <chrono/core/ChQuaternion.h>
 #include <chrono/physics/ChBody.h>
 #include <chrono/physics/ChSystemNSC.h>
+#include "renderer.hh"
+#include "scaling.hh"
+#include "autotune.hh"
+#include "conservation.hh"
 
 int width = 1280;
 int height = 720;
 
-const char *vertexSource = "#version 410 core\n\
-uniform float aspect;\n\
+const float a = 1.0;
+const float b = 0.1;
+const float c = 0.5;
+
+const char *vertexSource = "#version 410 core\n" GLOBALS_BLOCK "\
 uniform vec3 axes;\n\
 uniform vec3 translation;\n\
 uniform mat3 rotation;\n\
@@ -23,8 +31,7 @@ void main()\n\
   gl_Position = vec4((rotation * (point * axes) + translation) * vec3(1, aspect, 1), 1);\n\
 }";
 
-const char *fragmentSource = "#version 410 core\n\
-uniform vec3 light;\n\
+const char *fragmentSource = "#version 410 core\n" GLOBALS_BLOCK "\
 in vec3 n;\n\
 out vec3 fragColor;\n\
 void main()\n\
@@ -82,32 +89,46 @@ unsigned int indices[] = {
   20, 21, 22, 23
 };
 
-void handleCompileError(const char *step, GLuint shader)
+void setupSystem(chrono::ChSystemNSC &sys)
 {
-  GLint result = GL_FALSE;
-  glGetShaderiv(shader, GL_COMPILE_STATUS, &result);
-  if (result == GL_FALSE) {
-    char buffer[1024];
-    glGetShaderInfoLog(shader, 1024, NULL, buffer);
-    if (buffer[0])
-      fprintf(stderr, "%s: %s\n", step, buffer);
-  };
+  sys.SetTimestepperType(chrono::ChTimestepper::Type::RUNGEKUTTA45);
+  sys.SetGravitationalAcceleration(chrono::ChVector3(0.0, 0.0, 0.0));
 }
 
-void handleLinkError(const char *step, GLuint program)
+std::shared_ptr<chrono::ChBody> addCuboid(chrono::ChSystemNSC &sys)
 {
-  GLint result = GL_FALSE;
-  glGetProgramiv(program, GL_LINK_STATUS, &result);
-  if (result == GL_FALSE) {
-    char buffer[1024];
-    glGetProgramInfoLog(program, 1024, NULL, buffer);
-    if (buffer[0])
-      fprintf(stderr, "%s: %s\n", step, buffer);
-  };
+  // https://math.stackexchange.com/questions/4501028/calculating-moment-of-inertia-for-a-cuboid
+  auto body = chrono_types::make_shared<chrono::ChBody>();
+  body->SetName("Cuboid");
+  float mass = 10.0;
+  body->SetMass(mass);
+  body->SetInertiaXX(chrono::ChVector3(mass * (b * b + c * c) / 12.0,
+                                       mass * (a * a + c * c) / 12.0,
+                                       mass * (a * a + b * b) / 12.0));
+  body->SetPos(chrono::ChVector3(0.0, 0.0, 0.0));
+  body->SetPosDt(chrono::ChVector3(0.0, 0.0, 0.0));
+  body->SetAngVelLocal(chrono::ChVector3(0.3, 0.0, 5.0));
+  sys.AddBody(body);
+  return body;
 }
 
-int main(void)
+Scene createScene(void)
 {
+  auto sys = chrono_types::make_shared<chrono::ChSystemNSC>();
+  setupSystem(*sys);
+  addCuboid(*sys);
+  return Scene{sys};
+}
+
+int main(int argc, char *argv[])
+{
+  if (scalingOption(argc, argv, "tumble", createScene, 0.01, 1000))
+    return 0;
+  if (autotuneOption(argc, argv, "tumble", createScene, 0.01, 200))
+    return 0;
+  if (driftOption(argc, argv, "tumble", createScene, NULL, 1e-3, 1e-3))
+    return 0;
+
   glfwInit();
   GLFWwindow *window = glfwCreateWindow(width, height, "Tumbling motion with Project Chrono", NULL, NULL);
   glfwMakeContextCurrent(window);
@@ -116,21 +137,7 @@ int main(void)
   glClearColor(0.1f, 0.1f, 0.1f, 0.0f);
   glViewport(0, 0, width, height);
 
-  GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
-  glShaderSource(vertexShader, 1, &vertexSource, NULL);
-  glCompileShader(vertexShader);
-  handleCompileError("Vertex shader", vertexShader);
-
-  GLuint fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-  glShaderSource(fragmentShader, 1, &fragmentSource, NULL);
-  glCompileShader(fragmentShader);
-  handleCompileError("Fragment shader", fragmentShader);
-
-  GLuint program = glCreateProgram();
-  glAttachShader(program, vertexShader);
-  glAttachShader(program, fragmentShader);
-  glLinkProgram(program);
-  handleLinkError("Shader program", program);
+  Program program = createProgram(vertexSource, fragmentSource);
 
   GLuint vao;
   GLuint vbo;
@@ -146,12 +153,12 @@ int main(void)
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, idx);
   glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
 
-  glUseProgram(program);
+  glUseProgram(program.program);
 
-  glVertexAttribPointer(glGetAttribLocation(program, "point"),
+  glVertexAttribPointer(glGetAttribLocation(program.program, "point"),
                         3, GL_FLOAT, GL_FALSE,
                         6 * sizeof(float), (void *)0);
-  glVertexAttribPointer(glGetAttribLocation(program, "normal"),
+  glVertexAttribPointer(glGetAttribLocation(program.program, "normal"),
                         3, GL_FLOAT, GL_FALSE,
                         6 * sizeof(float), (void *)(3 * sizeof(float)));
 
@@ -162,58 +169,33 @@ int main(void)
   glEnable(GL_DEPTH_TEST);
 
   float light[3] = {0.36f, 0.8f, -0.48f};
-  glUniform3fv(glGetUniformLocation(program, "light"), 1, light);
-  glUniform1f(glGetUniformLocation(program, "aspect"), (float)width / (float)height);
-  float a = 1.0;
-  float b = 0.1;
-  float c = 0.5;
+  GLuint globals = createGlobals();
+  attachGlobals(program);
+  updateGlobals(globals, (float)width / (float)height, light);
   float axes[3] = {a, b, c};
-  glUniform3fv(glGetUniformLocation(program, "axes"), 1, axes);
+  glUniform3fv(program.axes, 1, axes);
 
   chrono::ChSystemNSC sys;
-  sys.SetTimestepperType(chrono::ChTimestepper::Type::RUNGEKUTTA45);
-  sys.SetGravitationalAcceleration(chrono::ChVector3(0.0, 0.0, 0.0));
+  setupSystem(sys);
+  useProfile("tumble", sys);
+  auto body = addCuboid(sys);
+  ConservationMonitor *monitor = conservationOption(argc, argv, sys, NULL, 1e-3, 1e-3);
 
-  // https://math.stackexchange.com/questions/4501028/calculating-moment-of-inertia-for-a-cuboid
-  auto body = chrono_types::make_shared<chrono::ChBody>();
-  body->SetName("Cuboid");
-  float mass = 10.0;
-  body->SetMass(mass);
-  body->SetInertiaXX(chrono::ChVector3(mass * (b * b + c * c) / 12.0,
-                                       mass * (a * a + c * c) / 12.0,
-                                       mass * (a * a + b * b) / 12.0));
-  body->SetPos(chrono::ChVector3(0.0, 0.0, 0.0));
-  body->SetPosDt(chrono::ChVector3(0.0, 0.0, 0.0));
-  body->SetAngVelLocal(chrono::ChVector3(0.3, 0.0, 5.0));
-  sys.AddBody(body);
+  DrawList draws;
 
   double t = glfwGetTime();
   while (!glfwWindowShouldClose(window)) {
     double dt = glfwGetTime() - t;
 
-    chrono::ChQuaternion quat = body->GetRot();
-    chrono::ChMatrix33 mat(quat);
-    chrono::ChVector3 x = mat.GetAxisX();
-    chrono::ChVector3 y = mat.GetAxisY();
-    chrono::ChVector3 z = mat.GetAxisZ();
-
-    float rotation[9] = {
-      (float)x.x(), (float)y.x(), (float)z.x(),
-      (float)x.y(), (float)y.y(), (float)z.y(),
-      (float)x.z(), (float)y.z(), (float)z.z()
-    };
-
-    glUniformMatrix3fv(glGetUniformLocation(program, "rotation"), 1, GL_TRUE, rotation);
-
-    chrono::ChVector3 position = body->GetPos();
-    float translation[3] = {(float)position.x(), (float)position.y(), (float)position.z()};
-    glUniform3fv(glGetUniformLocation(program, "translation"), 1, translation);
-
     glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
-    glDrawElements(GL_QUADS, 24, GL_UNSIGNED_INT, (void *)0);
+    draws.clear();
+    draws.add(program, vao, GL_QUADS, 24, *body);
+    draws.submit();
     glfwSwapBuffers(window);
     glfwPollEvents();
     sys.DoStepDynamics(dt);
+    if (monitor)
+      monitor->update();
     t += dt;
   };
 
@@ -224,9 +206,9 @@ int main(void)
   glBindVertexArray(0);
   glDeleteVertexArrays(1, &vao);
 
-  glDeleteProgram(program);
-  glDeleteShader(vertexShader);
-  glDeleteShader(fragmentShader);
+  delete monitor;
+  deleteGlobals(globals);
+  deleteProgram(program);
 
   glfwTerminate();
   return 0;
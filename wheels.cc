@@ -0,0 +1,97 @@
+#include <cmath>
+#include "wheels.hh"
+
+static const char *vertex_wheels = "#version 410 core\n" GLOBALS_BLOCK "\
+in vec3 point;\n\
+in vec3 translation;\n\
+in vec4 rotation;\n\
+in vec2 size;\n\
+vec3 rotate(vec4 q, vec3 v)\n\
+{\n\
+  return v + 2.0 * cross(q.yzw, cross(q.yzw, v) + q.x * v);\n\
+}\n\
+void main()\n\
+{\n\
+  vec3 rim_point = vec3(point.xy * size.x, point.z * size.y);\n\
+  gl_Position = vec4((rotate(rotation, rim_point) + translation) * vec3(1, aspect, depth), 1);\n\
+}";
+
+static const char *fragment_wheels = "#version 410 core\n\
+out vec3 fragColor;\n\
+void main()\n\
+{\n\
+  fragColor = vec3(1, 1, 1);\n\
+}";
+
+WheelRenderer::WheelRenderer(int num_points, int capacity):
+  num_points(num_points), capacity(capacity)
+{
+  program = createProgram(vertex_wheels, fragment_wheels);
+  attachGlobals(program);
+
+  // Both rims of a cylinder with unit radius and unit width
+  std::vector<GLfloat> vertices;
+  for (int j=0; j<2; j++)
+    for (int i=0; i<num_points; i++) {
+      double angle = 2.0 * M_PI * i / num_points;
+      vertices.push_back(cos(angle));
+      vertices.push_back(sin(angle));
+      vertices.push_back(j - 0.5f);
+    };
+
+  glGenVertexArrays(1, &vao);
+  glBindVertexArray(vao);
+
+  glGenBuffers(1, &vbo);
+  glBindBuffer(GL_ARRAY_BUFFER, vbo);
+  glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GLfloat), vertices.data(), GL_STATIC_DRAW);
+  GLint point = glGetAttribLocation(program.program, "point");
+  glVertexAttribPointer(point, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
+  glEnableVertexAttribArray(point);
+
+  glGenBuffers(1, &sizes);
+  glBindBuffer(GL_ARRAY_BUFFER, sizes);
+  glBufferData(GL_ARRAY_BUFFER, capacity * 2 * sizeof(GLfloat), NULL, GL_STATIC_DRAW);
+  GLint size = glGetAttribLocation(program.program, "size");
+  glVertexAttribPointer(size, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void *)0);
+  glVertexAttribDivisor(size, 1);
+  glEnableVertexAttribArray(size);
+
+  translation = glGetAttribLocation(program.program, "translation");
+  rotation = glGetAttribLocation(program.program, "rotation");
+  poses = new PoseBuffer(capacity);
+}
+
+WheelRenderer::~WheelRenderer()
+{
+  delete poses;
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glDeleteBuffers(1, &sizes);
+  glDeleteBuffers(1, &vbo);
+  glBindVertexArray(0);
+  glDeleteVertexArrays(1, &vao);
+  deleteProgram(program);
+}
+
+void WheelRenderer::add(std::shared_ptr<chrono::ChBody> wheel, float radius, float length)
+{
+  if ((int)wheels.size() >= capacity) return;
+  GLfloat size[2] = {radius, length};
+  glBindBuffer(GL_ARRAY_BUFFER, sizes);
+  glBufferSubData(GL_ARRAY_BUFFER, wheels.size() * sizeof(size), sizeof(size), size);
+  wheels.push_back(wheel);
+}
+
+void WheelRenderer::draw(const chrono::ChVector3d &offset)
+{
+  // Unlike PoseBuffer::update, fixed wheels are not skipped, so that instance i gets the size of wheel i
+  float *region = poses->begin();
+  for (unsigned int i=0; i<wheels.size(); i++)
+    poses->write(region, i, *wheels[i], offset);
+  poses->end(wheels.size());
+  glUseProgram(program.program);
+  glBindVertexArray(vao);
+  poses->bindAttributes(translation, rotation);
+  glDrawArraysInstanced(GL_POINTS, 0, 2 * num_points, poses->count);
+  poses->fence();
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <memory>
+#include <vector>
+#include <GL/glew.h>
+#include <chrono/physics/ChBody.h>
+#include "renderer.hh"
+#include "pose.hh"
+
+// Renderer drawing all registered wheels with a single instanced call.
+// The rims of a unit cylinder are generated once as a point cloud and each instance
+// scales them with its own radius and width and places them with the wheel pose.
+class WheelRenderer {
+public:
+  WheelRenderer(int num_points, int capacity);
+  ~WheelRenderer();
+
+  void add(std::shared_ptr<chrono::ChBody> wheel, float radius, float length);
+  void draw(const chrono::ChVector3d &offset = chrono::ChVector3d(0, 0, 0));
+
+  int num_points;
+  int capacity;
+  Program program;
+  std::vector<std::shared_ptr<chrono::ChBody>> wheels;
+
+protected:
+  GLuint vao;
+  GLuint vbo;
+  GLuint sizes;
+  GLint translation;
+  GLint rotation;
+  PoseBuffer *poses;
+};